@@ -2,6 +2,8 @@
 #define ASTEROID_H
 
 #include "Graphics.h"
+#include "ShapeLibrary.h"
+#include "Spokes.h"
 #include <iostream>
 
 #include <stdlib.h>
@@ -15,20 +17,29 @@ class Asteroid
 private:
 public:
   
-  Random<> r;
+  Random<Real> r;
 
+  // The outline lives in the ShapeLibrary, so an Asteroid owns no
+  // memory and can be copied or stored by value
   int    sides;
-  Point<> *points;
-  Point<>  location;
+  int    shape;            // Index into ShapeLibrary::shared()
 
-  Range<>  radius_range;
-  Range<>  rotation_range;
-  Range<>  velocity_range;
+  // Position, motion and rotation (in degrees) are Real, which is
+  // fixed point in a -DFIXED_POINT build so they step identically
+  // everywhere. The shape is float either way.
+  Point<Real>  location;
+  Point<Real>  previous_location; // Where the last update() started from
 
-  Vector2<float> velocity;
+  Range<>      radius_range;
+  float        outer_radius;   // Longest spoke of the shape
+  Range<Real>  rotation_range;
+  Range<Real>  velocity_range;
 
-  float  rotation_inc;
-  float  rotation;
+  Vector2<Real> velocity;
+
+  Real   rotation_inc;
+  Real   rotation;         // Kept in [0, 360)
+  Real   previous_rotation;
 
   int    fragment_count;
   int    explode_count;
@@ -36,70 +47,68 @@ public:
   bool   is_paused;
 
 public:
-  Asteroid( Range<> size = Range<>( 0.05f, 0.1f ) )
+  Asteroid( Range<> size = Range<>( 0.05f, 0.1f ), int sides = 12 )
   {
     this->fragment_count = 3;
     this->explode_count  = 2;
 
     this->radius_range   = size;
-    this->velocity_range = Range<>( 0.01f, 0.03f );
-    this->rotation_range = Range<>( -2.5f, 2.5f );
+    this->velocity_range = Range<Real>( Real( 0.01f ), Real( 0.03f ) );
+    this->rotation_range = Range<Real>( Real( -2.5f ), Real( 2.5f ) );
 
-    this->sides          = 12;
+    this->sides          = sides;
 
-    this->rotation       = 0;
+    this->rotation       = Real( 0 );
+    this->previous_rotation = Real( 0 );
     this->rotation_inc   = r.next( this->rotation_range );
 
-    this->velocity      = Vector2<float>::from_magnitude_and_direction( r.next( this->velocity_range.min, this->velocity_range.max ), r.next( 0, 360 * PI_OVER_180 ) );
+    this->velocity      = Vector2<Real>::from_magnitude_and_direction( r.next( this->velocity_range.min, this->velocity_range.max ), r.next( Real( 0 ), Real( 360 * PI_OVER_180 ) ) );
 
     this->is_paused      = false;
     
     this->generate_shape();
   }
 
-  ~Asteroid()
+  // Advances the asteroid by one simulation tick. Rendering is kept
+  // separate so the world can be stepped without a GL context.
+  void update()
   {
-    delete [] this->points;
-    this->points = NULL;
-  }
-
-  void draw()
-  {
-    if( !this->is_paused )
-    {
-      this->spin();
-      this->move();
-    }
-
-    glTranslatef( this->location.x, this->location.y, 0 );
-    glRotatef( this->rotation, 0, 0, 1);
+    // Wrapped before it is remembered, so drawing never interpolates
+    // across the jump
+    if( this->rotation >= Real( 360 ) )
+      this->rotation -= Real( 360 );
+    else if( this->rotation < Real( 0 ) )
+      this->rotation += Real( 360 );
 
-    glColor3f( 0, 0, 0 );
-    this->draw_points( GL_POLYGON );
+    this->previous_location = this->location;
+    this->previous_rotation = this->rotation;
 
-    glColor3f( 1, 1, 1 );
-    this->draw_points( GL_LINE_LOOP );
+    if( this->is_paused ) return;
 
-    glLoadIdentity();
+    this->spin();
+    this->move();
   }
 
-  void draw_points( GLenum mode = GL_LINE_LOOP )
+  // Writes the outline in world space as drawn "alpha" of the way
+  // from where the last update started to where it ended, so motion
+  // stays smooth when frames fall between simulation steps
+  void drawn_outline( float alpha, Point<> *out )
   {
-    glBegin( mode );
-      for( int i = 0; i < this->sides; i++ )
-        glVertex2f( points[i].x, points[i].y );
-    glEnd();
+    interpolate_outline( this->points(), this->sides, to_float( this->previous_rotation ), to_float( this->rotation ),
+                         to_float( this->previous_location ), to_float( this->location ), alpha, out );
   }
 
   void move()
   {
-    this->location.x += this->velocity.p.x;
-    this->location.y += this->velocity.p.y;
+    this->location += this->velocity.p;
   }
 
-  void move_to(Point<> p)
+  // Jumps to p. Wrapping and spawning go through here, so there is
+  // nothing to interpolate from.
+  void move_to(Point<Real> p)
   {
-    this->location = p;
+    this->location          = p;
+    this->previous_location = p;
   }
 
   void spin()
@@ -109,54 +118,54 @@ public:
 
   void check_boundaries(float h, float w)
   {
-    float half_of_width  = w / 2;
-    float half_of_height = h / 2;
+    Real half_of_width  = Real( w / 2 );
+    Real half_of_height = Real( h / 2 );
+    Real margin         = Real( this->radius_range.max );
 
-    if( this->location.x < -half_of_width - this->radius_range.max )
-      this->move_to( Point<>( half_of_width, this->location.y+this->radius_range.max ) );
+    if( this->location.x < -half_of_width - margin )
+      this->move_to( Point<Real>( half_of_width, this->location.y+margin ) );
 
-    else if( this->location.x > half_of_width + this->radius_range.max )
-      this->move_to( Point<>( -half_of_width, this->location.y-this->radius_range.max ) );
+    else if( this->location.x > half_of_width + margin )
+      this->move_to( Point<Real>( -half_of_width, this->location.y-margin ) );
 
-    else if( this->location.y < -half_of_height - this->radius_range.max )
-      this->move_to( Point<>( this->location.x, half_of_height+this->radius_range.max) );
+    else if( this->location.y < -half_of_height - margin )
+      this->move_to( Point<Real>( this->location.x, half_of_height+margin) );
 
-    else if( this->location.y > half_of_height + this->radius_range.max )
-      this->move_to( Point<>( this->location.x, -half_of_height-this->radius_range.max) );
+    else if( this->location.y > half_of_height + margin )
+      this->move_to( Point<Real>( this->location.x, -half_of_height-margin) );
   }
 
-  bool hit_test( Point<> coordinates )
+  // Radius of the circle that counts as a hit
+  float hit_radius()
   {
-    float d = this->location.distance_from( coordinates );
-    
-    return( d <= ( this->radius_range.max * 1.2 ) );
+    return( this->radius_range.max * 1.2f );
   }
 
-  Asteroid **get_fragments()
+  bool hit_test( Point<> coordinates )
   {
-    Asteroid **fragments = new Asteroid*[ this->fragment_count ];
+    float r = this->hit_radius();
+
+    return( distance_squared( to_float( this->location ), coordinates ) <= r*r );
+  }
 
+  // Builds the i'th of fragment_count pieces this asteroid breaks into
+  Asteroid get_fragment( int i )
+  {
     Range<> new_size( this->radius_range.min/(this->fragment_count * .75f), this->radius_range.max/(this->fragment_count * .75f) );
 
-    float direction = ( 360 / fragment_count ) * PI_OVER_180;
-    for( int i = 0; i < fragment_count; i++ )
-    {
-      fragments[i] = new Asteroid( new_size );
+    Real direction = Real( ( 360 / fragment_count ) * PI_OVER_180 );
+    Real heading   = direction * Real( i ) + this->velocity.angle();
 
-      Vector2<float> v = Vector2<float>::from_magnitude_and_direction( fragments[i]->radius_range.max, direction*i + this->velocity.angle() );
-      
-      fragments[i]->move_to( this->location + v.p );
-      fragments[i]->velocity = this->velocity + Vector2<float>::from_magnitude_and_direction( fragments[i]->velocity.length(), direction*i + this->velocity.angle() );
+    Asteroid fragment( new_size, this->sides );
 
-      fragments[i]->explode_count = this->explode_count-1;
-    }
+    Vector2<Real> v = Vector2<Real>::from_magnitude_and_direction( Real( fragment.radius_range.max ), heading );
 
-    return(fragments);
-  }
+    fragment.move_to( this->location + v.p );
+    fragment.velocity = this->velocity + Vector2<Real>::from_magnitude_and_direction( fragment.velocity.length(), heading );
 
-  ParticleSystem *get_particle_system()
-  {
-    return( new ParticleSystem( this->location ) );
+    fragment.explode_count = this->explode_count-1;
+
+    return( fragment );
   }
 
   bool can_explode()
@@ -164,21 +173,20 @@ public:
     return( this->explode_count > 0 );
   }
 
+  // Vertices of the outline, relative to the asteroid's centre
+  const Point<> *points()
+  {
+    return( ShapeLibrary::shared().points( this->shape ) );
+  }
+
 private:
   void generate_shape()
   {
-    float radius;
-    float tick;
-    this->points = new Point<>[sides];
-    Vector2<float> v;
-
-    for( int i = 0; i < sides; i++ )
-    {
-      tick            = (360 / sides) * i * PI_OVER_180;
-      radius          = r.next( this->radius_range.min, this->radius_range.max );
-      v               = Vector2<float>::from_magnitude_and_direction(radius, tick);
-      this->points[i] = v.p;
-    }
+    ShapeLibrary &library = ShapeLibrary::shared();
+
+    this->shape        = library.pick( this->sides, this->radius_range, this->r );
+    this->sides        = library.sides( this->shape ); // Clamped to what the library allows
+    this->outer_radius = library.outer_radius( this->shape );
   }
 };
 
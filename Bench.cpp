@@ -0,0 +1,675 @@
+/************************************************************/
+/* Filename: Bench.cpp                                      */
+/* Microbenchmarks of the primitives the game is built on:  */
+/* points and vectors, float against Q16.16 fixed point     */
+/* math, Random<>, LinkedList, asteroids, particle systems, */
+/* and outlines of 8, 12 and 16 sides.                      */
+/* Writes one JSON document with the time and heap          */
+/* allocations per operation of each, so the numbers can be */
+/* compared across revisions.                               */
+/*                                                          */
+/* Usage: bench [-n scale] [-f filter] [-o results.json]    */
+/*                                                          */
+/*   -n  multiply every benchmark's operation count         */
+/*   -f  only run benchmarks whose name contains this       */
+/*   -o  write the JSON here instead of to stdout           */
+/*                                                          */
+/* Build with -DBENCH_REVISION=\"$(git rev-parse HEAD)\" to */
+/* stamp the results with the revision they came from, and  */
+/* with -DFIXED_POINT to time the asteroids with fixed      */
+/* point physics.                                           */
+/************************************************************/
+
+#define HEADLESS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <vector>
+#include <type_traits>
+
+#include "Graphics.h"
+#include "Asteroid.h"
+#include "Collision.h"
+#include "LinkedList.h"
+#include "Clock.h"
+
+#ifndef BENCH_REVISION
+#define BENCH_REVISION "unknown"
+#endif
+
+using namespace Graphics;
+
+// Every heap allocation in the process goes through these, so the
+// benchmarks can count them. Pools get their blocks here too.
+unsigned long g_allocations = 0;
+
+void *operator new( size_t size )
+{
+  g_allocations++;
+
+  void *p = malloc( size ? size : 1 );
+  if( p == NULL ) throw std::bad_alloc();
+
+  return( p );
+}
+
+void *operator new[]( size_t size )
+{
+  return( operator new( size ) );
+}
+
+void operator delete( void *p ) noexcept
+{
+  free( p );
+}
+
+void operator delete[]( void *p ) noexcept
+{
+  free( p );
+}
+
+void operator delete( void *p, size_t ) noexcept
+{
+  free( p );
+}
+
+void operator delete[]( void *p, size_t ) noexcept
+{
+  free( p );
+}
+
+// Keeps the optimizer from throwing the benchmarked work away
+volatile float g_sink;
+
+struct Result
+{
+  const char *name;
+  long        ops;
+  double      ns_per_op;
+  double      allocs_per_op;
+};
+
+std::vector<Result> g_results;
+long                g_scale  = 1;
+const char         *g_filter = NULL;
+
+// Time and allocations spent setting up inside a benchmark, which are
+// taken back out of its results
+double        g_untimed             = 0;
+unsigned long g_untimed_allocations = 0;
+
+struct Untimed
+{
+  double        start;
+  unsigned long allocations;
+
+  Untimed()
+  {
+    this->start       = now_in_seconds();
+    this->allocations = g_allocations;
+  }
+
+  ~Untimed()
+  {
+    g_untimed             += now_in_seconds() - this->start;
+    g_untimed_allocations += g_allocations - this->allocations;
+  }
+};
+
+// Runs body(ops) once to warm caches and pools, then three more times,
+// keeping the fastest. body does "ops" operations and returns
+// something to sink; setup it does under an Untimed does not count.
+template< typename F >
+void bench( const char *name, long ops, F body )
+{
+  if( g_filter != NULL && strstr( name, g_filter ) == NULL ) return;
+
+  ops *= g_scale;
+
+  g_sink = float( body( ops / 10 + 1 ) );
+
+  double        best        = 0;
+  unsigned long allocations = 0;
+
+  for( int run = 0; run < 3; run++ )
+  {
+    g_untimed             = 0;
+    g_untimed_allocations = 0;
+
+    unsigned long before = g_allocations;
+    double        start  = now_in_seconds();
+
+    g_sink = float( body( ops ) );
+
+    double elapsed = now_in_seconds() - start - g_untimed;
+
+    if( run == 0 || elapsed < best )
+      best = elapsed;
+
+    allocations = g_allocations - before - g_untimed_allocations;
+  }
+
+  Result result = { name, ops, best / ops * 1e9, double( allocations ) / ops };
+  g_results.push_back( result );
+
+  fprintf( stderr, "%-40s %10.2f ns/op %8.3f allocs/op\n", name, result.ns_per_op, result.allocs_per_op );
+}
+
+// Inputs: a fixed spread, so no call is trivially cheap or foldable
+const int INPUTS = 4096;
+float     g_a[ INPUTS ];
+float     g_b[ INPUTS ];
+float2    g_points[ INPUTS ];
+Fixed     g_fixed_a[ INPUTS ];
+Fixed     g_fixed_b[ INPUTS ];
+
+void make_inputs()
+{
+  Random<> r( 12345 );
+
+  for( int i = 0; i < INPUTS; i++ )
+  {
+    g_a[i] = r.next( -1.0f, 1.0f );
+    g_b[i] = r.next( -1.0f, 1.0f );
+
+    g_points[i] = float2( g_a[i], g_b[i] );
+
+    g_fixed_a[i] = Fixed( g_a[i] );
+    g_fixed_b[i] = Fixed( g_b[i] );
+  }
+}
+
+int g_visited;
+
+void visit( int item )
+{
+  g_visited += item;
+}
+
+void bench_geometry()
+{
+  bench( "Point::distance_from", 20000000, []( long ops )
+  {
+    float sum = 0;
+    for( long i = 0; i < ops; i++ )
+    {
+      int k = int( i & ( INPUTS - 1 ) );
+      sum += Point<>( g_a[k], g_b[k] ).distance_from( Point<>( g_b[k], g_a[k] ) );
+    }
+    return( sum );
+  } );
+
+  bench( "float2 distance_squared", 20000000, []( long ops )
+  {
+    float sum = 0;
+    for( long i = 0; i < ops; i++ )
+    {
+      int k = int( i & ( INPUTS - 1 ) );
+      sum += distance_squared( float2( g_a[k], g_b[k] ), float2( g_b[k], g_a[k] ) );
+    }
+    return( sum );
+  } );
+
+  bench( "float2 bounds (per point)", 50000000, []( long ops )
+  {
+    float sum = 0;
+
+    for( long done = 0; done < ops; done += INPUTS )
+      sum += bounds( g_points, INPUTS ).z;
+
+    return( sum );
+  } );
+
+  bench( "Vector::end_point", 20000000, []( long ops )
+  {
+    float sum = 0;
+    for( long i = 0; i < ops; i++ )
+    {
+      int k = int( i & ( INPUTS - 1 ) );
+      sum += Vector( Point<>( g_a[k], g_b[k] ), g_a[k] * 10, g_b[k] ).end_point().x;
+    }
+    return( sum );
+  } );
+
+  bench( "Vector::add", 10000000, []( long ops )
+  {
+    float sum = 0;
+    for( long i = 0; i < ops; i++ )
+    {
+      int k = int( i & ( INPUTS - 1 ) );
+      Vector a( Point<>( g_a[k], g_b[k] ), g_a[k] * 10, g_b[k] );
+      Vector b( Point<>(), g_b[k] * 10, g_a[k] );
+
+      sum += a.add( b ).direction;
+    }
+    return( sum );
+  } );
+
+  bench( "Vector2::from_magnitude_and_direction", 20000000, []( long ops )
+  {
+    float sum = 0;
+    for( long i = 0; i < ops; i++ )
+    {
+      int k = int( i & ( INPUTS - 1 ) );
+      sum += Vector2<float>::from_magnitude_and_direction( g_a[k], g_b[k] * 10 ).p.y;
+    }
+    return( sum );
+  } );
+
+  bench( "Vector2::angle", 20000000, []( long ops )
+  {
+    float sum = 0;
+    for( long i = 0; i < ops; i++ )
+    {
+      int k = int( i & ( INPUTS - 1 ) );
+      sum += Vector2<float>( g_a[k], g_b[k] ).angle();
+    }
+    return( sum );
+  } );
+}
+
+// Every point moved by its velocity, as Asteroid::move does
+template< typename T >
+T move_points( long ops )
+{
+  Point<T>   points[ 1024 ];
+  Vector2<T> velocities[ 1024 ];
+
+  for( int i = 0; i < 1024; i++ )
+    velocities[i] = Vector2<T>( T( g_a[i] * .03f ), T( g_b[i] * .03f ) );
+
+  for( long done = 0; done < ops; done += 1024 )
+    for( int i = 0; i < 1024; i++ )
+      points[i] += velocities[i].p;
+
+  return( points[ ops & 1023 ].x );
+}
+
+// The same operations on floats and on Q16.16 fixed point, in pairs
+void bench_numeric()
+{
+  bench( "FastMath::sincos", 50000000, []( long ops )
+  {
+    float sum = 0;
+    for( long i = 0; i < ops; i++ )
+    {
+      float s, c;
+      FastMath::sincos( g_a[ i & ( INPUTS - 1 ) ] * 10, s, c );
+      sum += s + c;
+    }
+    return( sum );
+  } );
+
+  bench( "FixedMath::sincos", 50000000, []( long ops )
+  {
+    Fixed sum;
+    for( long i = 0; i < ops; i++ )
+    {
+      Fixed s, c;
+      FixedMath::sincos( g_fixed_a[ i & ( INPUTS - 1 ) ] * Fixed( 10 ), s, c );
+      sum += s + c;
+    }
+    return( sum.to_float() );
+  } );
+
+  bench( "FastMath::atan2", 50000000, []( long ops )
+  {
+    float sum = 0;
+    for( long i = 0; i < ops; i++ )
+    {
+      int k = int( i & ( INPUTS - 1 ) );
+      sum += FastMath::atan2( g_a[k], g_b[k] );
+    }
+    return( sum );
+  } );
+
+  bench( "FixedMath::atan2", 50000000, []( long ops )
+  {
+    Fixed sum;
+    for( long i = 0; i < ops; i++ )
+    {
+      int k = int( i & ( INPUTS - 1 ) );
+      sum += FixedMath::atan2( g_fixed_a[k], g_fixed_b[k] );
+    }
+    return( sum.to_float() );
+  } );
+
+  bench( "FastMath::sqrt", 50000000, []( long ops )
+  {
+    float sum = 0;
+    for( long i = 0; i < ops; i++ )
+      sum += FastMath::sqrt( g_a[ i & ( INPUTS - 1 ) ] + 1 );
+    return( sum );
+  } );
+
+  bench( "FixedMath::sqrt", 50000000, []( long ops )
+  {
+    Fixed sum;
+    for( long i = 0; i < ops; i++ )
+      sum += FixedMath::sqrt( g_fixed_a[ i & ( INPUTS - 1 ) ] + Fixed( 1 ) );
+    return( sum.to_float() );
+  } );
+
+  bench( "Vector2<Fixed>::from_magnitude_and_direction", 20000000, []( long ops )
+  {
+    Fixed sum;
+    for( long i = 0; i < ops; i++ )
+    {
+      int k = int( i & ( INPUTS - 1 ) );
+      sum += Vector2<Fixed>::from_magnitude_and_direction( g_fixed_a[k], g_fixed_b[k] * Fixed( 10 ) ).p.y;
+    }
+    return( sum.to_float() );
+  } );
+
+  bench( "Vector2<Fixed>::angle", 20000000, []( long ops )
+  {
+    Fixed sum;
+    for( long i = 0; i < ops; i++ )
+    {
+      int k = int( i & ( INPUTS - 1 ) );
+      sum += Vector2<Fixed>( g_fixed_a[k], g_fixed_b[k] ).angle();
+    }
+    return( sum.to_float() );
+  } );
+
+  bench( "Point<float> += velocity (per point)", 200000000, []( long ops )
+  {
+    return( move_points<float>( ops ) );
+  } );
+
+  bench( "Point<Fixed> += velocity (per point)", 200000000, []( long ops )
+  {
+    return( move_points<Fixed>( ops ).to_float() );
+  } );
+}
+
+void bench_random()
+{
+  bench( "Random::next()", 50000000, []( long ops )
+  {
+    Random<> r( 1 );
+    float    sum = 0;
+    for( long i = 0; i < ops; i++ )
+      sum += r.next();
+    return( sum );
+  } );
+
+  bench( "Random::next(max)", 50000000, []( long ops )
+  {
+    Random<> r( 1 );
+    float    sum = 0;
+    for( long i = 0; i < ops; i++ )
+      sum += r.next( 10.0f );
+    return( sum );
+  } );
+
+  bench( "Random::next(min,max)", 50000000, []( long ops )
+  {
+    Random<> r( 1 );
+    float    sum = 0;
+    for( long i = 0; i < ops; i++ )
+      sum += r.next( -1.0f, 1.0f );
+    return( sum );
+  } );
+
+  bench( "Random::next(Range)", 50000000, []( long ops )
+  {
+    Random<> r( 1 );
+    Range<>  range( -1.0f, 1.0f );
+    float    sum = 0;
+    for( long i = 0; i < ops; i++ )
+      sum += r.next( range );
+    return( sum );
+  } );
+
+  bench( "Random::fill (per value)", 50000000, []( long ops )
+  {
+    Random<> r( 1 );
+    float    out[ 1024 ];
+    float    sum = 0;
+    for( long done = 0; done < ops; done += 1024 )
+    {
+      r.fill( out, 1024, Range<>( -1.0f, 1.0f ) );
+      sum += out[ done & 1023 ];
+    }
+    return( sum );
+  } );
+}
+
+void bench_linked_list()
+{
+  // Lists are built and torn down in batches, so the node pool stays
+  // warm and each side is timed on its own
+  bench( "LinkedList::insert", 10000000, []( long ops )
+  {
+    long size = 0;
+
+    for( long done = 0; done < ops; done += 4096 )
+    {
+      LinkedList<int> list;
+      for( int i = 0; i < 4096; i++ )
+        list.insert( i );
+
+      size += list.getSize();
+
+      Untimed untimed;
+      while( list.removeHead() ) {}
+    }
+
+    return( size );
+  } );
+
+  bench( "LinkedList::removeHead", 10000000, []( long ops )
+  {
+    long removed = 0;
+
+    for( long done = 0; done < ops; done += 4096 )
+    {
+      LinkedList<int> list;
+      {
+        Untimed untimed;
+        for( int i = 0; i < 4096; i++ )
+          list.insert( i );
+      }
+
+      while( list.removeHead() )
+        removed++;
+    }
+
+    return( removed );
+  } );
+
+  bench( "LinkedList::each (per item)", 50000000, []( long ops )
+  {
+    LinkedList<int> list;
+    for( int i = 0; i < 1000; i++ )
+      list.insert( i );
+
+    g_visited = 0;
+    for( long done = 0; done < ops; done += 1000 )
+      list.each( visit );
+
+    return( g_visited );
+  } );
+}
+
+void bench_entities()
+{
+  bench( "Asteroid::Asteroid", 2000000, []( long ops )
+  {
+    float sum = 0;
+    for( long i = 0; i < ops; i++ )
+    {
+      Asteroid asteroid( Range<>( .1f, .2f ) );
+      sum += asteroid.outer_radius;
+    }
+    return( sum );
+  } );
+
+  bench( "Asteroid::get_fragment", 1000000, []( long ops )
+  {
+    Asteroid asteroid( Range<>( .1f, .2f ) );
+    float    sum = 0;
+
+    for( long i = 0; i < ops; i++ )
+      for( int f = 0; f < asteroid.fragment_count; f++ )
+        sum += to_float( asteroid.get_fragment( f ).location ).x;
+
+    return( sum );
+  } );
+
+  std::vector<Asteroid> asteroids;
+  for( int i = 0; i < 1024; i++ )
+    asteroids.push_back( Asteroid( Range<>( .1f, .2f ) ) );
+
+  bench( "Asteroid::update + check_boundaries", 20000000, [&]( long ops )
+  {
+    float sum = 0;
+
+    for( long done = 0; done < ops; done += 1024 )
+    {
+      for( int i = 0; i < 1024; i++ )
+      {
+        asteroids[i].update();
+        asteroids[i].check_boundaries( 3, 4 );
+      }
+
+      sum += to_float( asteroids[ done & 1023 ].location ).x;
+    }
+    return( sum );
+  } );
+
+  bench( "ParticleSystem::generate_points (1500)", 20000, []( long ops )
+  {
+    ParticleSystem particles;
+    float          sum = 0;
+
+    for( long i = 0; i < ops; i++ )
+    {
+      particles.generate_points();
+      sum += particles.vx[ i % particles.count ];
+    }
+    return( sum );
+  } );
+
+  bench( "ParticleSystem::move (1500)", 200000, []( long ops )
+  {
+    ParticleSystem particles;
+
+    for( long i = 0; i < ops; i++ )
+      particles.move();
+
+    return( particles.x[0] );
+  } );
+}
+
+// The outline code for one of the side counts it is specialized for
+void bench_outlines( int sides, const char *outline_name, const char *overlap_name )
+{
+  std::vector<Asteroid> asteroids;
+  for( int i = 0; i < 64; i++ )
+  {
+    asteroids.push_back( Asteroid( Range<>( .1f, .2f ), sides ) );
+    asteroids.back().move_to( to_real( Point<>( g_a[i] * .3f, g_b[i] * .3f ) ) );
+    asteroids.back().rotation = Real( g_a[ i + 64 ] * 180 );
+  }
+
+  bench( outline_name, 20000000, [&]( long ops )
+  {
+    Point<> outline[ Collision::MAX_SIDES ];
+    float   sum = 0;
+
+    for( long i = 0; i < ops; i++ )
+    {
+      asteroids[ i & 63 ].drawn_outline( .5f, outline );
+      sum += outline[ sides - 1 ].x;
+    }
+    return( sum );
+  } );
+
+  bench( overlap_name, 5000000, [&]( long ops )
+  {
+    long hits = 0;
+
+    for( long i = 0; i < ops; i++ )
+      hits += Collision::outlines_overlap( asteroids[ i & 63 ], asteroids[ ( i >> 6 ) & 63 ], Point<>( 0, 0 ) );
+
+    return( hits );
+  } );
+}
+
+void bench_shapes()
+{
+  bench_outlines( 8,  "Asteroid::drawn_outline (8 sides)",  "Collision::outlines_overlap (8 sides)" );
+  bench_outlines( 12, "Asteroid::drawn_outline (12 sides)", "Collision::outlines_overlap (12 sides)" );
+  bench_outlines( 16, "Asteroid::drawn_outline (16 sides)", "Collision::outlines_overlap (16 sides)" );
+}
+
+void write_json( FILE *out )
+{
+  fprintf( out, "{\n" );
+  fprintf( out, "  \"revision\": \"%s\",\n", BENCH_REVISION );
+  fprintf( out, "  \"compiler\": \"%s\",\n", __VERSION__ );
+  fprintf( out, "  \"physics\": \"%s\",\n", std::is_same< Real, Fixed >::value ? "fixed" : "float" );
+  fprintf( out, "  \"particle_kernel\": \"%s\",\n", ParticleKernels::path_name( ParticleKernels::current_path() ) );
+  fprintf( out, "  \"benchmarks\": [\n" );
+
+  for( size_t i = 0; i < g_results.size(); i++ )
+  {
+    const Result &r = g_results[i];
+
+    fprintf( out, "    { \"name\": \"%s\", \"ops\": %ld, \"ns_per_op\": %.3f, \"allocs_per_op\": %.4f }%s\n",
+             r.name, r.ops, r.ns_per_op, r.allocs_per_op, i + 1 < g_results.size() ? "," : "" );
+  }
+
+  fprintf( out, "  ]\n}\n" );
+}
+
+int main( int argc, char **argv )
+{
+  const char *path = NULL;
+
+  for( int i = 1; i < argc; i += 2 )
+  {
+    if( i + 1 < argc && strcmp( argv[i], "-n" ) == 0 )
+      g_scale = atol( argv[i + 1] );
+    else if( i + 1 < argc && strcmp( argv[i], "-f" ) == 0 )
+      g_filter = argv[i + 1];
+    else if( i + 1 < argc && strcmp( argv[i], "-o" ) == 0 )
+      path = argv[i + 1];
+    else
+      g_scale = 0;
+  }
+
+  if( g_scale <= 0 )
+  {
+    fprintf( stderr, "usage: %s [-n scale] [-f filter] [-o results.json]\n", argv[0] );
+    return( 1 );
+  }
+
+  seed_random( 1 );
+  make_inputs();
+
+  bench_geometry();
+  bench_numeric();
+  bench_random();
+  bench_linked_list();
+  bench_entities();
+  bench_shapes();
+
+  FILE *out = path ? fopen( path, "w" ) : stdout;
+  if( out == NULL )
+  {
+    fprintf( stderr, "could not write %s\n", path );
+    return( 1 );
+  }
+
+  write_json( out );
+
+  if( path )
+    fclose( out );
+
+  return( 0 );
+}
@@ -0,0 +1,15 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <chrono>
+
+namespace Graphics
+{
+  // Monotonic wall clock time, in seconds from an arbitrary start
+  inline double now_in_seconds()
+  {
+    return( std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count() );
+  }
+}
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <math.h>
+
+#include "Graphics.h"
+#include "Asteroid.h"
+
+namespace Graphics
+{
+  // What happens when two asteroids touch
+  enum CollisionMode
+  {
+    COLLIDE_NONE,     // They pass through each other
+    COLLIDE_BOUNCE,   // Elastic bounce, mass proportional to area
+    COLLIDE_FRAGMENT  // Both explode (as if clicked); ones that can't, bounce
+  };
+
+  // Counters and timings for the most recent tick's collision pass
+  struct CollisionStats
+  {
+    long   grid_candidates; // Pairs the grid handed to the broad phase
+    long   broad_pairs;     // Pairs whose bounding circles overlap
+    long   contacts;        // Pairs whose outlines actually overlap
+
+    double grid_time;       // Seconds spent rebuilding the grid
+    double broad_time;
+    double narrow_time;
+    double response_time;
+
+    CollisionStats()
+    {
+      this->reset();
+    }
+
+    void reset()
+    {
+      this->grid_candidates = this->broad_pairs = this->contacts = 0;
+      this->grid_time = this->broad_time = this->narrow_time = this->response_time = 0;
+    }
+  };
+
+  namespace Collision
+  {
+    // Largest number of outline vertices the narrow phase handles
+    const int MAX_SIDES = ShapeLibrary::MAX_SIDES;
+
+    // Writes the asteroid's outline in world space, shifted by offset
+    inline void outline( Asteroid &a, Point<> offset, Point<> *out )
+    {
+      float s, c;
+      FastMath::sincos( to_float( a.rotation ) * PI_OVER_180, s, c );
+
+      transform_outline( a.points(), a.sides, s, c, to_float( a.location ) + offset, out );
+    }
+
+    // Whether segments p1-p2 and q1-q2 properly cross
+    inline bool segments_intersect( float2 p1, float2 p2, float2 q1, float2 q2 )
+    {
+      float d1 = cross( q2 - q1, p1 - q1 );
+      float d2 = cross( q2 - q1, p2 - q1 );
+      float d3 = cross( p2 - p1, q1 - p1 );
+      float d4 = cross( p2 - p1, q2 - p1 );
+
+      return( ( ( d1 > 0 ) != ( d2 > 0 ) ) && ( ( d3 > 0 ) != ( d4 > 0 ) ) );
+    }
+
+    // Even-odd ray cast; the outlines are star shaped, not convex
+    inline bool point_in_polygon( float2 p, const float2 *polygon, int n )
+    {
+      bool inside = false;
+
+      for( int i = 0, j = n - 1; i < n; j = i++ )
+      {
+        if( ( polygon[i].y > p.y ) != ( polygon[j].y > p.y ) &&
+            p.x < ( polygon[j].x - polygon[i].x ) * ( p.y - polygon[i].y ) / ( polygon[j].y - polygon[i].y ) + polygon[i].x )
+          inside = !inside;
+      }
+
+      return( inside );
+    }
+
+    // Edges of "polygon" that reach into "box" (min x, min y, max x,
+    // max y); returns how many were written to "edges" (index of each
+    // edge's end)
+    inline int edges_in_box( const float2 *polygon, int n, float4 box, int *edges )
+    {
+      int count = 0;
+
+      for( int i = 0, p = n - 1; i < n; p = i++ )
+      {
+        if( !overlaps( float4( min( polygon[p], polygon[i] ), max( polygon[p], polygon[i] ) ), box ) )
+          continue;
+
+        edges[ count++ ] = i;
+      }
+
+      return( count );
+    }
+
+    // Exact test of the two outlines. b_offset moves b next to a when
+    // the pair touches across the wrap. Only edges that reach into the
+    // other outline's bounding box are tested against each other.
+    inline bool outlines_overlap( Asteroid &a, Asteroid &b, Point<> b_offset )
+    {
+      Point<> pa[ MAX_SIDES ];
+      Point<> pb[ MAX_SIDES ];
+      int     ea[ MAX_SIDES ];
+      int     eb[ MAX_SIDES ];
+
+      outline( a, Point<>( 0, 0 ), pa );
+      outline( b, b_offset, pb );
+
+      float4 box_a = bounds( pa, a.sides );
+      float4 box_b = bounds( pb, b.sides );
+
+      if( !overlaps( box_a, box_b ) )
+        return( false );
+
+      int na = edges_in_box( pa, a.sides, box_b, ea );
+      int nb = edges_in_box( pb, b.sides, box_a, eb );
+
+      for( int i = 0; i < na; i++ )
+      {
+        Point<> a0 = pa[ ( ea[i] + a.sides - 1 ) % a.sides ];
+        Point<> a1 = pa[ ea[i] ];
+
+        for( int j = 0; j < nb; j++ )
+          if( segments_intersect( a0, a1, pb[ ( eb[j] + b.sides - 1 ) % b.sides ], pb[ eb[j] ] ) )
+            return( true );
+      }
+
+      // No edges cross, so either they are apart or one is inside
+      return( point_in_polygon( pa[0], pb, b.sides ) || point_in_polygon( pb[0], pa, a.sides ) );
+    }
+
+    // Whether a and b are moving towards each other along "normal"
+    // (which points from a to b)
+    inline bool approaching( Asteroid &a, Asteroid &b, Point<> normal )
+    {
+      return( dot( to_float( ( b.velocity - a.velocity ).p ), normal ) < 0 );
+    }
+
+    // Elastic bounce along the line between the centres, worked out
+    // in the physics' number type. Each side takes a share of the
+    // impulse by the other's mass (the square of its radius); the
+    // share comes from the ratio of the radii, which unlike the masses
+    // themselves keeps its precision in fixed point.
+    inline void bounce( Asteroid &a, Asteroid &b, Point<> normal )
+    {
+      Vector2<Real> n( to_real( normal ) );
+
+      Real length2 = n.dot( n );
+      if( length2 == Real( 0 ) ) return;
+
+      n.p = n.p * Numeric::rsqrt( length2 );
+
+      Real closing = ( b.velocity - a.velocity ).dot( n );
+      if( closing >= Real( 0 ) ) return;
+
+      Real ratio = Real( a.radius_range.max ) / Real( b.radius_range.max );
+      Real share = Real( 1 ) / ( Real( 1 ) + ratio * ratio ); // mb / ( ma + mb )
+      Real kick  = Real( -2 ) * closing;
+
+      a.velocity.p -= n.p * ( kick * share );
+      b.velocity.p += n.p * ( kick * ( Real( 1 ) - share ) );
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef DRAW_LIST_H
+#define DRAW_LIST_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "Graphics.h"
+#include "Asteroid.h"
+#include "World.h"
+#include "Collision.h"
+#include "RenderState.h"
+
+namespace Graphics
+{
+  /* Everything one frame of a World draws, flattened into batches  */
+  /* in world coordinates: asteroid fills as triangles, outlines as   */
+  /* separate line segments, particles as points and their trails as */
+  /* line segments that fade from the particle's color to nothing.    */
+  /* Points and trail vertices carry an RGBA byte color each.         */
+  /*                                                                  */
+  /* Trails are a drawing effect only: each runs back along the       */
+  /* particle's velocity, so its length costs vertices, not steps.    */
+  /* Building the list needs no GL, so the same list feeds the GL     */
+  /* renderer and the software one. It is built from a RenderState,   */
+  /* never from the asteroids and particle systems themselves, so it  */
+  /* can be built on a thread other than the simulation's. The arrays */
+  /* keep their capacity between frames.                              */
+  class DrawList
+  {
+  public:
+    float trail; // Trail length, in ticks of motion; 0 for none
+
+    // Vertices; colors are RGBA bytes, one per vertex
+    std::vector<float2>        fills;
+    std::vector<float2>        lines;
+    std::vector<float2>        points;
+    std::vector<unsigned char> colors;
+    std::vector<float2>        trails;
+    std::vector<unsigned char> trail_colors;
+
+    DrawList()
+    {
+      this->trail = .75f;
+    }
+
+    // Fills the batches with the state "alpha" of the way between the
+    // start and the end of its tick
+    void build( const RenderState &state, float alpha )
+    {
+      this->build_asteroids( state, alpha );
+      this->build_particles( state, alpha );
+    }
+
+    // The same for a world, captured first on this thread
+    void build( World &world, float alpha )
+    {
+      this->captured.capture( world );
+      this->build( this->captured, alpha );
+    }
+
+    int fill_vertices()  const { return( int( this->fills.size() ) ); }
+    int line_vertices()  const { return( int( this->lines.size() ) ); }
+    int point_vertices() const { return( int( this->points.size() ) ); }
+    int trail_vertices() const { return( int( this->trails.size() ) ); }
+
+  private:
+    RenderState captured; // Scratch for building straight from a World
+
+    // Fills are fans of triangles around each asteroid's centre (the
+    // shapes are star shaped, so this is exact); outlines are one
+    // line per edge
+    void build_asteroids( const RenderState &state, float alpha )
+    {
+      size_t fill_size = 0;
+      size_t line_size = 0;
+
+      for( size_t a = 0; a < state.asteroids.size(); a++ )
+      {
+        fill_size += 3 * state.asteroids[a].sides;
+        line_size += 2 * state.asteroids[a].sides;
+      }
+
+      this->fills.resize( fill_size );
+      this->lines.resize( line_size );
+
+      float2 *fill = fill_size ? &this->fills[0] : NULL;
+      float2 *line = line_size ? &this->lines[0] : NULL;
+
+      float2 outline[ Collision::MAX_SIDES ];
+
+      for( size_t a = 0; a < state.asteroids.size(); a++ )
+      {
+        const RenderState::Pose &pose = state.asteroids[a];
+
+        interpolate_outline( state.points( pose.shape ), pose.sides, pose.from_rotation, pose.to_rotation,
+                             pose.from, pose.to, alpha, outline );
+
+        float2 center = lerp( pose.from, pose.to, alpha );
+
+        for( int i = 0, p = pose.sides - 1; i < pose.sides; p = i++ )
+        {
+          *fill++ = center;
+          *fill++ = outline[p];
+          *fill++ = outline[i];
+
+          *line++ = outline[p];
+          *line++ = outline[i];
+        }
+      }
+    }
+
+    // Each particle is drawn where it was "lag" ticks ago, and its
+    // trail reaches "trail" ticks further back along its velocity
+    void build_particles( const RenderState &state, float alpha )
+    {
+      size_t point_count = state.particle_count();
+      size_t trail_count = this->trail > 0 ? 2 * point_count : 0;
+
+      this->points.resize( point_count );
+      this->colors.resize( 4 * point_count );
+      this->trails.resize( trail_count );
+      this->trail_colors.resize( 4 * trail_count );
+
+      float2        *point       = point_count ? &this->points[0] : NULL;
+      unsigned char *color       = point_count ? &this->colors[0] : NULL;
+      float2        *trail       = trail_count ? &this->trails[0] : NULL;
+      unsigned char *trail_color = trail_count ? &this->trail_colors[0] : NULL;
+
+      for( size_t b = 0; b < state.bursts.size(); b++ )
+      {
+        const RenderState::Burst &burst = state.bursts[b];
+        const unsigned char      *rgba  = burst.rgba;
+
+        const float *x  = state.x.data() + burst.first;
+        const float *y  = state.y.data() + burst.first;
+        const float *vx = state.vx.data() + burst.first;
+        const float *vy = state.vy.data() + burst.first;
+
+        float lag = burst.is_paused ? 0 : 1 - alpha;
+
+        ParticleKernels::emit( x, y, vx, vy, burst.count, lag, floats( point ) );
+        point += burst.count;
+
+        for( int i = 0; i < burst.count; i++, color += 4 )
+          copy_color( color, rgba, rgba[3] );
+
+        if( trail == NULL ) continue;
+
+        ParticleKernels::emit_segments( x, y, vx, vy, burst.count, lag, lag + this->trail, floats( trail ) );
+        trail += 2 * burst.count;
+
+        for( int i = 0; i < burst.count; i++, trail_color += 8 )
+        {
+          copy_color( trail_color, rgba, rgba[3] );
+          copy_color( trail_color + 4, rgba, 0 );
+        }
+      }
+    }
+
+    static void copy_color( unsigned char *out, const unsigned char *rgba, unsigned char alpha )
+    {
+      out[0] = rgba[0];
+      out[1] = rgba[1];
+      out[2] = rgba[2];
+      out[3] = alpha;
+    }
+  };
+}
+
+#endif
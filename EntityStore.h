@@ -0,0 +1,285 @@
+#ifndef ENTITY_STORE_H
+#define ENTITY_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <new>
+#include <utility>
+
+namespace Graphics
+{
+  /* A dense array of entities of type T with generational handles.   */
+  /*                                                                  */
+  /* Live entities are always packed into items[0..size), so walking */
+  /* them is a linear pass over memory. Removing one moves the last   */
+  /* entity into its place (O(1), order is not kept). A Handle names  */
+  /* an entity independently of where it currently sits; once the     */
+  /* entity is removed the handle's generation no longer matches and  */
+  /* get() returns NULL instead of some other entity.                 */
+  /*                                                                  */
+  /* T must be move constructible.                                    */
+  template< typename T >
+  class EntityStore
+  {
+  public:
+    struct Handle
+    {
+      uint32_t slot;
+      uint32_t generation;
+
+      Handle()
+      {
+        this->slot       = 0;
+        this->generation = 0; // Generation 0 is never handed out
+      }
+
+      Handle( uint32_t slot, uint32_t generation )
+      {
+        this->slot       = slot;
+        this->generation = generation;
+      }
+
+      bool operator==( Handle h ) const
+      {
+        return( this->slot == h.slot && this->generation == h.generation );
+      }
+
+      bool operator!=( Handle h ) const
+      {
+        return( !( *this == h ) );
+      }
+    };
+
+    EntityStore()
+    {
+      this->items      = NULL;
+      this->owners     = NULL;
+      this->slots      = NULL;
+      this->count      = 0;
+      this->capacity   = 0;
+      this->slot_count = 0;
+      this->free_slot  = NONE;
+    }
+
+    ~EntityStore()
+    {
+      this->clear();
+
+      ::operator delete( this->items );
+      delete [] this->owners;
+      delete [] this->slots;
+    }
+
+    int size() const
+    {
+      return( this->count );
+    }
+
+    bool isEmpty() const
+    {
+      return( this->count == 0 );
+    }
+
+    T &operator[]( int i )
+    {
+      return( this->items[i] );
+    }
+
+    T *begin()
+    {
+      return( this->items );
+    }
+
+    T *end()
+    {
+      return( this->items + this->count );
+    }
+
+    // Moves an entity into the store and returns its handle
+    Handle insert( T &&item )
+    {
+      if( this->count == this->capacity )
+        this->grow( this->capacity ? this->capacity * 2 : 16 );
+
+      uint32_t slot = this->take_slot();
+
+      ::new ( this->items + this->count ) T( std::move( item ) );
+
+      this->owners[ this->count ] = slot;
+      this->slots[ slot ].index   = this->count;
+      this->count++;
+
+      return( Handle( slot, this->slots[ slot ].generation ) );
+    }
+
+    // Returns the entity a handle refers to, or NULL if it is gone
+    T *get( Handle h )
+    {
+      if( !this->contains( h ) ) return( NULL );
+
+      return( this->items + this->slots[ h.slot ].index );
+    }
+
+    bool contains( Handle h ) const
+    {
+      return( h.slot < this->slot_count && h.generation != 0 &&
+              this->slots[ h.slot ].generation == h.generation );
+    }
+
+    // Handle of the entity currently at dense index i
+    Handle handle_at( int i ) const
+    {
+      uint32_t slot = this->owners[i];
+      return( Handle( slot, this->slots[ slot ].generation ) );
+    }
+
+    // Dense index of a live handle, or -1
+    int index_of( Handle h ) const
+    {
+      return( this->contains( h ) ? int( this->slots[ h.slot ].index ) : -1 );
+    }
+
+    bool remove( Handle h )
+    {
+      if( !this->contains( h ) ) return( false );
+
+      this->remove_at( this->slots[ h.slot ].index );
+      return( true );
+    }
+
+    // Removes the entity at dense index i by moving the last entity
+    // into its place. When removing while iterating, walk backwards.
+    void remove_at( int i )
+    {
+      int last = this->count - 1;
+
+      this->release_slot( this->owners[i] );
+      this->items[i].~T();
+
+      if( i != last )
+      {
+        ::new ( this->items + i ) T( std::move( this->items[ last ] ) );
+        this->items[ last ].~T();
+
+        this->owners[i] = this->owners[ last ];
+        this->slots[ this->owners[i] ].index = i;
+      }
+
+      this->count--;
+    }
+
+    // Copies n entities in with a single memcpy, for bulk loads. T
+    // must be trivially copyable. The new entities get fresh handles.
+    void append( const T *from, int n )
+    {
+      this->reserve( this->count + n );
+
+      memcpy( (void*)( this->items + this->count ), from, sizeof( T ) * n );
+
+      for( int i = 0; i < n; i++ )
+      {
+        uint32_t slot = this->take_slot();
+
+        this->owners[ this->count ] = slot;
+        this->slots[ slot ].index   = this->count;
+        this->count++;
+      }
+    }
+
+    void clear()
+    {
+      while( this->count > 0 )
+        this->remove_at( this->count - 1 );
+    }
+
+    void reserve( int n )
+    {
+      if( n > this->capacity )
+        this->grow( n );
+    }
+
+  private:
+    static const uint32_t NONE = 0xffffffffu;
+
+    // A slot maps a handle to the entity's current dense index. Free
+    // slots are chained through "index".
+    struct Slot
+    {
+      uint32_t index;
+      uint32_t generation;
+    };
+
+    T        *items;
+    uint32_t *owners; // Slot of the entity at each dense index
+    Slot     *slots;
+
+    int      count;
+    int      capacity;
+    uint32_t slot_count;
+    uint32_t free_slot;
+
+    EntityStore( const EntityStore & );
+    EntityStore &operator=( const EntityStore & );
+
+    void grow( int new_capacity )
+    {
+      T        *new_items  = (T*)::operator new( sizeof( T ) * new_capacity );
+      uint32_t *new_owners = new uint32_t[ new_capacity ];
+      Slot     *new_slots  = new Slot[ new_capacity ];
+
+      for( int i = 0; i < this->count; i++ )
+      {
+        ::new ( new_items + i ) T( std::move( this->items[i] ) );
+        this->items[i].~T();
+
+        new_owners[i] = this->owners[i];
+      }
+
+      for( uint32_t i = 0; i < this->slot_count; i++ )
+        new_slots[i] = this->slots[i];
+
+      ::operator delete( this->items );
+      delete [] this->owners;
+      delete [] this->slots;
+
+      this->items    = new_items;
+      this->owners   = new_owners;
+      this->slots    = new_slots;
+      this->capacity = new_capacity;
+    }
+
+    // There are never more slots than capacity, since every slot in
+    // use belongs to a live entity
+    uint32_t take_slot()
+    {
+      uint32_t slot;
+
+      if( this->free_slot != NONE )
+      {
+        slot            = this->free_slot;
+        this->free_slot = this->slots[ slot ].index;
+      }
+      else
+      {
+        slot = this->slot_count++;
+        this->slots[ slot ].generation = 0;
+      }
+
+      this->slots[ slot ].generation++;
+      if( this->slots[ slot ].generation == 0 )
+        this->slots[ slot ].generation = 1;
+
+      return( slot );
+    }
+
+    void release_slot( uint32_t slot )
+    {
+      this->slots[ slot ].generation++;
+      this->slots[ slot ].index = this->free_slot;
+      this->free_slot           = slot;
+    }
+  };
+}
+
+#endif
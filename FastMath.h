@@ -0,0 +1,155 @@
+#ifndef FAST_MATH_H
+#define FAST_MATH_H
+
+// A -DFIXED_POINT build has to replay bit for bit anywhere. What stays
+// in float there (shapes, collision tests, particles) rounds the same
+// on every IEEE machine, as long as the compiler does not fuse
+// multiplies and adds, which GCC and Clang do by default given FMA.
+#ifdef FIXED_POINT
+#if defined( __clang__ )
+#pragma STDC FP_CONTRACT OFF
+#elif defined( __GNUC__ )
+#pragma GCC optimize( "fp-contract=off" )
+#endif
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined( __SSE__ ) || defined( _M_X64 )
+#define FAST_MATH_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace Graphics
+{
+  /* Approximations of the trig the game uses every tick, all in     */
+  /* float and branch-light so they inline well. Worst errors against */
+  /* libm in double, as measured by MathBench.cpp:                    */
+  /*                                                                  */
+  /*   sincos  |angle| <= 1e4 rad    1.1e-7 absolute                  */
+  /*   atan2   any finite x, y       2.0e-6 rad absolute              */
+  /*   rsqrt   normal x > 0          2.7e-7 relative with SSE,        */
+  /*                                 4.8e-6 without                   */
+  /*                                                                  */
+  /* Far below a pixel at any window size, but not bit for bit the    */
+  /* same as libm.                                                    */
+  namespace FastMath
+  {
+    const float PI         = 3.14159265358979f;
+    const float HALF_PI    = 1.57079632679490f;
+    const float TWO_OVER_PI = 0.636619772367581f;
+
+    // sin and cos of "angle" (radians) at once. The angle is brought
+    // into [-pi/4, pi/4] by a multiple of pi/2 (subtracted in three
+    // parts so the reduction stays exact), then both are evaluated as
+    // Taylor polynomials, which are accurate to float there.
+    inline void sincos( float angle, float &s, float &c )
+    {
+      float k = angle * TWO_OVER_PI;
+      int   quadrant = int( k < 0 ? k - 0.5f : k + 0.5f );
+      float q = float( quadrant );
+
+      float r = angle - q * 1.5703125f;
+      r = r - q * 4.83751296997e-4f;
+      r = r - q * 7.54978995489e-8f;
+
+      float r2 = r * r;
+
+      float sin_r = r + r * r2 * ( -1.0f / 6 + r2 * ( 1.0f / 120 + r2 * ( -1.0f / 5040 + r2 * ( 1.0f / 362880 ) ) ) );
+      float cos_r = 1 + r2 * ( -0.5f + r2 * ( 1.0f / 24 + r2 * ( -1.0f / 720 + r2 * ( 1.0f / 40320 ) ) ) );
+
+      // Odd quadrants swap sin and cos; the signs follow the quadrant.
+      // Written as selects rather than a switch, since the quadrant is
+      // effectively random and a mispredicted branch costs more than
+      // the polynomials.
+      bool swap = ( quadrant & 1 ) != 0;
+
+      s = swap ? cos_r : sin_r;
+      c = swap ? sin_r : cos_r;
+
+      if( quadrant & 2 )         s = -s;
+      if( ( quadrant + 1 ) & 2 ) c = -c;
+    }
+
+    inline float sin( float angle )
+    {
+      float s, c;
+      sincos( angle, s, c );
+
+      return( s );
+    }
+
+    inline float cos( float angle )
+    {
+      float s, c;
+      sincos( angle, s, c );
+
+      return( c );
+    }
+
+    // atan of a in [0, 1] (Abramowitz & Stegun style odd polynomial)
+    inline float atan_unit( float a )
+    {
+      float a2 = a * a;
+
+      return( a * ( 0.99997726f + a2 * ( -0.33262347f + a2 * ( 0.19354346f +
+                    a2 * ( -0.11643287f + a2 * ( 0.05265332f + a2 * -0.01172120f ) ) ) ) ) );
+    }
+
+    // Angle of (x, y) in (-pi, pi], and 0 for (0, 0). Works on the
+    // octant the point falls in, so there are no special cases on the
+    // axes.
+    inline float atan2( float y, float x )
+    {
+      float ax = x < 0 ? -x : x;
+      float ay = y < 0 ? -y : y;
+
+      float big   = ax > ay ? ax : ay;
+      float small = ax > ay ? ay : ax;
+
+      if( big == 0 ) return( 0 );
+
+      float angle = atan_unit( small / big );
+
+      if( ay > ax ) angle = HALF_PI - angle;
+      if( x < 0 )   angle = PI - angle;
+      if( y < 0 )   angle = -angle;
+
+      return( angle );
+    }
+
+    // 1 / sqrt(x): the CPU's 12 bit estimate where there is one, or one
+    // from the float's bit pattern, refined by Newton steps
+    inline float rsqrt( float x )
+    {
+#ifdef FAST_MATH_SSE
+      float y = _mm_cvtss_f32( _mm_rsqrt_ss( _mm_set_ss( x ) ) );
+
+      return( y * ( 1.5f - 0.5f * x * y * y ) );
+#else
+      uint32_t bits;
+      memcpy( &bits, &x, sizeof( bits ) );
+
+      bits = 0x5f375a86u - ( bits >> 1 );
+
+      float y;
+      memcpy( &y, &bits, sizeof( y ) );
+
+      float half = 0.5f * x;
+      y = y * ( 1.5f - half * y * y );
+      y = y * ( 1.5f - half * y * y );
+
+      return( y );
+#endif
+    }
+
+    // sqrt(x) through rsqrt, with sqrt(0) = 0
+    inline float sqrt( float x )
+    {
+      return( x > 0 ? x * rsqrt( x ) : 0 );
+    }
+  }
+}
+
+#endif
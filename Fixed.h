@@ -0,0 +1,232 @@
+#ifndef FIXED_H
+#define FIXED_H
+
+#include <stdint.h>
+#include <math.h>
+
+#include "FastMath.h"
+#include "SpokeMath.h"
+
+namespace Graphics
+{
+  /* A Q16.16 fixed point number: a 32 bit integer counting 65536ths, */
+  /* so +-32768 in steps of 1.5e-5. All of its arithmetic is integer  */
+  /* arithmetic, which comes out bit for bit the same on every        */
+  /* compiler, optimization level and CPU. Float math does not        */
+  /* promise that: compilers may fuse a multiply and an add, and the  */
+  /* SSE rsqrt estimate differs between vendors.                      */
+  /*                                                                  */
+  /* Sums wrap on overflow, products and quotients are rounded down   */
+  /* and towards zero (right shifts of negative numbers are taken to  */
+  /* be arithmetic, as on every compiler the game builds with).       */
+  /* Conversions to and from float are explicit so floats can't creep */
+  /* into fixed point math unnoticed. Converting to float is exact as */
+  /* long as the value fits in 24 bits.                               */
+  class Fixed
+  {
+  public:
+    int32_t raw; // The value times 65536
+
+    static const int FRACTION_BITS = 16;
+
+    constexpr Fixed() : raw( 0 ) {}
+    constexpr explicit Fixed( int v ) : raw( int32_t( uint32_t( v ) << FRACTION_BITS ) ) {}
+    constexpr explicit Fixed( double v ) : raw( int32_t( v * 65536 + ( v < 0 ? -.5 : .5 ) ) ) {}
+
+    static constexpr Fixed from_raw( int32_t raw )
+    {
+      return( Fixed( raw, RAW ) );
+    }
+
+    constexpr float to_float() const
+    {
+      return( float( this->raw ) * ( 1.0f / 65536 ) );
+    }
+
+    constexpr explicit operator float() const
+    {
+      return( this->to_float() );
+    }
+
+  private:
+    enum Raw { RAW };
+
+    constexpr Fixed( int32_t raw, Raw ) : raw( raw ) {}
+  };
+
+  static_assert( sizeof( Fixed ) == sizeof( int32_t ), "a Fixed is its raw integer" );
+
+  constexpr Fixed operator+( Fixed a, Fixed b ) { return( Fixed::from_raw( int32_t( uint32_t( a.raw ) + uint32_t( b.raw ) ) ) ); }
+  constexpr Fixed operator-( Fixed a, Fixed b ) { return( Fixed::from_raw( int32_t( uint32_t( a.raw ) - uint32_t( b.raw ) ) ) ); }
+  constexpr Fixed operator-( Fixed a )          { return( Fixed::from_raw( int32_t( 0u - uint32_t( a.raw ) ) ) ); }
+  constexpr Fixed operator*( Fixed a, Fixed b ) { return( Fixed::from_raw( int32_t( ( int64_t( a.raw ) * b.raw ) >> Fixed::FRACTION_BITS ) ) ); }
+  constexpr Fixed operator/( Fixed a, Fixed b ) { return( Fixed::from_raw( int32_t( int64_t( a.raw ) * 65536 / b.raw ) ) ); }
+
+  inline Fixed &operator+=( Fixed &a, Fixed b ) { return( a = a + b ); }
+  inline Fixed &operator-=( Fixed &a, Fixed b ) { return( a = a - b ); }
+  inline Fixed &operator*=( Fixed &a, Fixed b ) { return( a = a * b ); }
+  inline Fixed &operator/=( Fixed &a, Fixed b ) { return( a = a / b ); }
+
+  constexpr bool operator==( Fixed a, Fixed b ) { return( a.raw == b.raw ); }
+  constexpr bool operator!=( Fixed a, Fixed b ) { return( a.raw != b.raw ); }
+  constexpr bool operator< ( Fixed a, Fixed b ) { return( a.raw <  b.raw ); }
+  constexpr bool operator> ( Fixed a, Fixed b ) { return( a.raw >  b.raw ); }
+  constexpr bool operator<=( Fixed a, Fixed b ) { return( a.raw <= b.raw ); }
+  constexpr bool operator>=( Fixed a, Fixed b ) { return( a.raw >= b.raw ); }
+
+  /* FastMath's functions for Fixed, computed so the result depends   */
+  /* on nothing but the input: integer arithmetic throughout, besides */
+  /* one double square root, which IEEE 754 has rounded exactly.      */
+  /* Angles go through a binary angle (2^32 to the turn, so it wraps  */
+  /* by itself) into a quarter turn sine table. Worst errors, as      */
+  /* measured by MathBench.cpp:                                       */
+  /*                                                                  */
+  /*   sincos  any angle             4.2e-5 absolute                  */
+  /*   atan2   any x, y              9.3e-6 rad absolute              */
+  /*   sqrt    any x >= 0            1.5e-5 absolute (rounded down)   */
+  namespace FixedMath
+  {
+    const Fixed PI = Fixed::from_raw( 205887 );
+
+    // sin of 0, 1, ..., 257 256ths of a quarter turn, times 65536. One
+    // past the quarter so the last step has something to interpolate to.
+    template< typename I = SpokeMath::MakeIndices< 258 >::type >
+    struct SineTable;
+
+    template< int... I >
+    struct SineTable< SpokeMath::Indices< I... > >
+    {
+      static constexpr int32_t values[ sizeof...( I ) ] = { int32_t( SpokeMath::spoke_sin( I, 1024 ) * 65536 + .5 )... };
+    };
+
+    template< int... I >
+    constexpr int32_t SineTable< SpokeMath::Indices< I... > >::values[ sizeof...( I ) ];
+
+    // Radians as a binary angle. 2^32 / 2pi, times 65536 to keep the
+    // fraction, is 683565276; the product is taken modulo 2^48.
+    inline uint32_t binary_angle( Fixed radians )
+    {
+      return( uint32_t( uint64_t( int64_t( radians.raw ) * 683565276 ) >> 16 ) );
+    }
+
+    // sin of a binary angle, folded into the first quarter turn
+    inline int32_t binary_sin( uint32_t angle )
+    {
+      uint32_t within = angle & 0x3fffffffu;
+      if( angle & 0x40000000u )
+        within = 0x40000000u - within;
+
+      const int32_t *table    = SineTable<>::values;
+      uint32_t       step     = within >> 22;
+      int64_t        fraction = ( within >> 6 ) & 0xffff;
+
+      int32_t value = table[ step ] + int32_t( ( ( table[ step + 1 ] - table[ step ] ) * fraction ) >> 16 );
+
+      return( angle & 0x80000000u ? -value : value );
+    }
+
+    inline void sincos( Fixed angle, Fixed &s, Fixed &c )
+    {
+      uint32_t a = binary_angle( angle );
+
+      s = Fixed::from_raw( binary_sin( a ) );
+      c = Fixed::from_raw( binary_sin( a + 0x40000000u ) );
+    }
+
+    // FastMath::atan_unit's polynomial in Q2.30, for t / 2^30 in [0, 1]
+    inline int64_t atan_unit( int64_t t )
+    {
+      int64_t t2 = ( t * t ) >> 30;
+      int64_t p  = -12585543;
+
+      p = 56536072   + ( ( p * t2 ) >> 30 );
+      p = -125018842 + ( ( p * t2 ) >> 30 );
+      p = 207815708  + ( ( p * t2 ) >> 30 );
+      p = -357151731 + ( ( p * t2 ) >> 30 );
+      p = 1073717407 + ( ( p * t2 ) >> 30 );
+
+      return( ( p * t ) >> 30 );
+    }
+
+    // Angle of (x, y) in (-pi, pi], and 0 for (0, 0), by the same
+    // octants as FastMath::atan2. Worked out in Q2.30 and rounded.
+    inline Fixed atan2( Fixed y, Fixed x )
+    {
+      int64_t ax = x.raw < 0 ? -int64_t( x.raw ) : x.raw;
+      int64_t ay = y.raw < 0 ? -int64_t( y.raw ) : y.raw;
+
+      int64_t big   = ax > ay ? ax : ay;
+      int64_t small = ax > ay ? ay : ax;
+
+      if( big == 0 ) return( Fixed() );
+
+      int64_t angle = atan_unit( ( small << 30 ) / big );
+
+      if( ay > ax )    angle = 1686629713 - angle; // pi/2
+      if( x.raw < 0 )  angle = 3373259426 - angle; // pi
+      if( y.raw < 0 )  angle = -angle;
+
+      return( Fixed::from_raw( int32_t( ( angle + ( 1 << 13 ) ) >> 14 ) ) );
+    }
+
+    // Integer square root, rounded down. The double square root of n
+    // (exact in a double) is correctly rounded on every IEEE machine
+    // and within one of the answer; integers settle the last step.
+    inline uint64_t isqrt( uint64_t n )
+    {
+      uint64_t root = uint64_t( ::sqrt( double( n ) ) );
+
+      if( root * root > n )
+        root--;
+      else if( ( root + 1 ) * ( root + 1 ) <= n )
+        root++;
+
+      return( root );
+    }
+
+    // sqrt(x), with 0 for x <= 0
+    inline Fixed sqrt( Fixed x )
+    {
+      return( Fixed::from_raw( x.raw > 0 ? int32_t( isqrt( uint64_t( x.raw ) << 16 ) ) : 0 ) );
+    }
+
+    // 1 / sqrt(x), with 0 where sqrt(x) is 0
+    inline Fixed rsqrt( Fixed x )
+    {
+      Fixed root = sqrt( x );
+
+      return( root.raw > 0 ? Fixed( 1 ) / root : Fixed() );
+    }
+  }
+
+  /* The scalar math of Point<>, Vector2<> and the asteroid physics,  */
+  /* for either number type, so the same code compiles for both.      */
+  namespace Numeric
+  {
+    inline void  sincos( float angle, float &s, float &c ) { FastMath::sincos( angle, s, c ); }
+    inline void  sincos( Fixed angle, Fixed &s, Fixed &c ) { FixedMath::sincos( angle, s, c ); }
+
+    inline float atan2( float y, float x ) { return( FastMath::atan2( y, x ) ); }
+    inline Fixed atan2( Fixed y, Fixed x ) { return( FixedMath::atan2( y, x ) ); }
+
+    inline float sqrt( float x ) { return( FastMath::sqrt( x ) ); }
+    inline Fixed sqrt( Fixed x ) { return( FixedMath::sqrt( x ) ); }
+
+    inline float rsqrt( float x ) { return( FastMath::rsqrt( x ) ); }
+    inline Fixed rsqrt( Fixed x ) { return( FixedMath::rsqrt( x ) ); }
+  }
+
+  constexpr float to_float( float v ) { return( v ); }
+  constexpr float to_float( Fixed v ) { return( v.to_float() ); }
+
+  /* The number type of the asteroid physics (positions, velocities   */
+  /* and rotations): float, or Fixed when built with -DFIXED_POINT,   */
+  /* for runs that have to replay bit for bit on any machine.         */
+#ifdef FIXED_POINT
+  typedef Fixed Real;
+#else
+  typedef float Real;
+#endif
+}
+
+#endif
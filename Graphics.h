@@ -1,6 +1,11 @@
 #include "Range.h"
 #include "Random.h"
 #include "Point.h"
+#include "Fixed.h"
+#include "ParticleKernels.h"
+#include "Pool.h"
+#include "FastMath.h"
+#include <string.h>
 
 #ifndef GRAPHICS_H
 #define GRAPHICS_H
@@ -9,13 +14,15 @@ namespace Graphics
 {
   const float PI_OVER_180 = 0.0174532925f;  // One Degree (in Radians).      //
 
-  void garbage_collect( void *v )
+  template< typename T >
+  void garbage_collect( T *v )
   {
     delete v;
     v = NULL;
   }
 
-  void garbage_collect_array( void *v )
+  template< typename T >
+  void garbage_collect_array( T *v )
   {
     delete [] v;
     v = NULL;
@@ -48,8 +55,11 @@ namespace Graphics
 
     Point<> end_point()
     {
-      float x = this->magnitude * cosf( direction ) + this->origin.x;
-      float y = this->magnitude * sinf( direction ) + this->origin.y;
+      float s, c;
+      FastMath::sincos( this->direction, s, c );
+
+      float x = this->magnitude * c + this->origin.x;
+      float y = this->magnitude * s + this->origin.y;
 
       return( Point<>( x, y ) );
     }
@@ -68,101 +78,69 @@ namespace Graphics
       Vector new_vector;
       new_vector.origin    = this->origin;
       new_vector.magnitude = this->origin.distance_from( end );
-      new_vector.direction = atanf( ( end.y - new_vector.origin.y ) / ( end.x - new_vector.origin.x ) );
+      new_vector.direction = FastMath::atan2( end.y - new_vector.origin.y, end.x - new_vector.origin.x );
 
       return( new_vector );
     }
   };
 
   
+  // A velocity or offset: a Point<T> wrapped with vector operations,
+  // in floats or (for the fixed point physics) Fixed
   template<typename T>
   class Vector2
   {
   public:
-	  //T x, y;
-    
     Point<T> p;
-	
-    Vector2()
-    {
-      this->p.x = this->p.y = 0;
-    }
 
-	  Vector2( T x, T y )
-    {
-      this->p.x = x;
-      this->p.y = y;
-    }
+    constexpr Vector2() : p() {}
+    constexpr Vector2( T x, T y ) : p( x, y ) {}
+    constexpr Vector2( Point<T> p ) : p( p ) {}
 
     static Vector2 from_magnitude_and_direction( T magnitude, T direction )
     {
-      T x = magnitude * cos( direction );
-      T y = magnitude * sin( direction );
+      T s, c;
+      Numeric::sincos( direction, s, c );
 
-      return( Vector2( x, y ) );
+      return( Vector2( magnitude * c, magnitude * s ) );
     }
 
-	  Vector2 operator+( Vector2 v )
-	  {
-      return( Vector2( this->p.x + v.p.x, this->p.y + v.p.y ) );
-    }
+    constexpr Vector2 operator+( Vector2 v ) const { return( Vector2( this->p + v.p ) ); }
+    constexpr Vector2 operator-( Vector2 v ) const { return( Vector2( this->p - v.p ) ); }
 
-	  Vector2 operator-( Vector2 v )
-	  {
-      return( Vector2( this->p.x - v.p.x, this->p.y - v.p.y ) );
-    }
-
-	  Vector2& operator+=( Vector2 v )
-	  { 
-      this->p.x += v.p.x;
-      this->p.y += v.p.y;
-      
+    Vector2 &operator+=( Vector2 v )
+    {
+      this->p += v.p;
       return( *this );
     }
 
-	  Vector2& operator-=( Vector2 v )
-	  { 
-      this->p.x -= v.p.x;
-      this->p.y -= v.p.y;
-      
+    Vector2 &operator-=( Vector2 v )
+    {
+      this->p -= v.p;
       return( *this );
     }
 
-	  T dot( Vector2 v )
-	  {
-      return( ( this->p.x * v.p.x ) + ( this->p.y * v.p.y ) );
+    constexpr T dot( Vector2 v ) const
+    {
+      return( this->p.x * v.p.x + this->p.y * v.p.y );
     }
 
-	  T length()
+    T length() const
     {
-      return( sqrt( ( this->p.x * this->p.x ) + ( this->p.y * this->p.y ) ) );
+      return( Numeric::sqrt( this->dot( *this ) ) );
     }
 
-    T angle()
+    // Direction in radians, in [0, 2pi). Points on the axes (and the
+    // zero vector, which gets 0) are handled like any other.
+    T angle() const
     {
-      T quadrant_adjust;
-
-      if( this->p.x > 0 && this->p.y > 0 ) // First Quadrant
-        quadrant_adjust = 0;
-      else if( this->p.x < 0 && this->p.y > 0 ) // Second Quadrant
-        quadrant_adjust = 180;
-      else if( this->p.x < 0 && this->p.y < 0 ) // Third Quadrant
-        quadrant_adjust = 180;
-      else if( this->p.x > 0 && this->p.y < 0 ) // Fourth Quadrant
-        quadrant_adjust = 360;
-
-      return( atan( ( this->p.y ) / ( this->p.x ) ) + ( quadrant_adjust * PI_OVER_180 ) );
-    }
+      T angle = Numeric::atan2( this->p.y, this->p.x );
 
-	  bool operator==( Vector2 v )
-	  {
-      return( ( this->p.x == v.p.x ) && ( this->p.y == v.p.y ) );
+      return( angle < T( 0 ) ? angle + T( 2 * FastMath::PI ) : angle );
     }
 
-	  bool operator!=( Vector2 v )
-	  {
-      return( !( *this == v ) );
-    }
+    constexpr bool operator==( Vector2 v ) const { return( this->p == v.p ); }
+    constexpr bool operator!=( Vector2 v ) const { return( this->p != v.p ); }
   };
 
   class ParticleSystem
@@ -170,7 +148,16 @@ namespace Graphics
   public:
     Point<>   location;
     int     count;
-    Vector *particles;
+
+    // Particle state is kept as a structure of arrays (all x's, then
+    // all y's, ...) carved out of a single allocation. Velocities are
+    // cartesian so a step is just two adds per particle.
+    PooledArray<float> particles;
+    float  *x, *y;
+    float  *vx, *vy;
+
+    unsigned int lanes[ ParticleKernels::LANES ]; // Jitter random state
+
     Random<>  r;
     Range<>   velocity_range;
     int     display_count, display_max;
@@ -183,17 +170,18 @@ namespace Graphics
     bool is_clean;
     bool is_paused;
 
-    void init( Point<> origin )
+    void init( Point<> origin, int count = 1500 )
     {
       this->location = origin; 
-      this->count  = 1500;
-      this->velocity_range = Range<>( 0.0f, 0.010f );
+      this->count  = count;
+      this->velocity_range = Range<>( 0.0f, 0.040f );
       this->display_count = 0;
       this->display_max = 100;
 
       this->color[0] = 1.0f;
       this->color[1] = 1.0f;
       this->color[2] = 1.0f;
+      this->opacity  = 1.0f;
 
       this->chaos = .5f;
 
@@ -204,67 +192,108 @@ namespace Graphics
       this->generate_points();
     }
 
-    ParticleSystem( Point<> origin = Point<>() )
+    ParticleSystem( Point<> origin = Point<>(), int count = 1500 )
     {
-      this->init( origin );
+      this->init( origin, count );
     }
 
-    ~ParticleSystem()
+    // A system whose particles (x, y, vx and vy, "count" floats each)
+    // are copied from "state" instead of generated, or which had
+    // already released them if "state" is NULL. Everything else is
+    // left for the caller to fill in.
+    ParticleSystem( int count, const float *state )
     {
-      this->cleanup();
+      this->count    = count;
+      this->is_clean = ( state == NULL );
+
+      if( this->is_clean )
+        this->x = this->y = this->vx = this->vy = NULL;
+      else
+      {
+        this->allocate();
+        memcpy( this->x, state, 4 * count * sizeof( float ) );
+      }
     }
 
     void generate_points()
     {
       float velocity;
       float tick;
-      this->particles = new Vector[count];
+      this->allocate();
+
+      for( int i = 0; i < ParticleKernels::LANES; i++ )
+        this->lanes[i] = r.bits() | 1;
+
+      // Speeds are drawn in one batch into vx, then turned into
+      // cartesian velocities in place
+      r.fill( this->vx, this->count, this->velocity_range );
 
       for( int i = 0; i < this->count; i++ )
       {
-        tick               = ( float(this->count) / 360 ) * i * PI_OVER_180;
-        velocity           = r.next( this->velocity_range );
-        this->particles[i] = Vector( this->location, tick, velocity );
+        tick          = ( float(this->count) / 360 ) * i * PI_OVER_180;
+        velocity      = this->vx[i];
+
+        this->x[i]    = this->location.x;
+        this->y[i]    = this->location.y;
+        float s, c;
+        FastMath::sincos( tick, s, c );
+
+        this->vx[i]   = velocity * c;
+        this->vy[i]   = velocity * s;
       }
     }
 
+    // One pooled buffer holds all four arrays
+    void allocate()
+    {
+      this->particles.acquire( 4 * count );
+
+      this->x        = this->particles.get();
+      this->y        = this->x + count;
+      this->vx       = this->y + count;
+      this->vy       = this->vx + count;
+    }
+
     void cleanup()
     {
       if( this->is_clean ) return;
 
-      garbage_collect_array( this->particles );
+      this->particles.release();
 
       this->is_clean = true;
     }
 
-    bool draw( int blur = 0 )
+    // Whether the system has faded out and can be thrown away
+    bool is_expired()
     {
-      if( this->display_count >= this->display_max )
+      return( this->display_count >= this->display_max );
+    }
+
+    // Ends the system now, as if it had faded out
+    void retire()
+    {
+      this->display_count = this->display_max;
+      this->cleanup();
+    }
+
+    // Advances every particle and ages the system by one tick.
+    // Returns false once the system has faded out and released its
+    // particles.
+    bool update()
+    {
+      if( this->is_expired() )
       {
         this->cleanup();
         return(false);
       }
-      else
-      {
-        this->set_opacity();
-
-        glColor4f( this->color[0], this->color[1], this->color[2], this->opacity );
-        glBegin( GL_POINTS  );
-          for( int i = 0; i < blur+1; i++ )
-          {
-            for( int j = 0; j < count; j++ )
-            {
-              this->draw_particle(j);
-              this->move(j);
-            }
-          }
-        glEnd();
-
-        if( !this->is_paused )
-          this->display_count++;
-
-        return(true);
-      }
+
+      if( this->is_paused ) return(true);
+
+      this->move();
+
+      this->display_count++;
+
+      return(true);
     }
 
     void set_opacity()
@@ -272,20 +301,14 @@ namespace Graphics
       this->opacity = 1 - float(this->display_count) / this->display_max;
     }
 
-    void draw_particle( int i )
-    {
-      glVertex2fv( this->particles[i].origin.to_array() );
-    }
-
-    void move( int i )
+    // Moves every particle one tick, jittering it by up to chaos/50
+    // in each direction
+    void move()
     {
       if( this->is_paused ) return;
 
-      Point<> p = this->particles[i].end_point();
-      p.x += r.next( -this->chaos, this->chaos ) / 100;
-      p.y += r.next( -this->chaos, this->chaos ) / 100;
-
-      this->particles[i].origin = p;
+      ParticleKernels::step( this->x, this->y, this->vx, this->vy, this->count,
+                             this->lanes, this->chaos / 50, NULL );
     }
   };
 
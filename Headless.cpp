@@ -0,0 +1,548 @@
+/************************************************************/
+/* Filename: Headless.cpp                                   */
+/* Runs the asteroid simulation without a window so it can  */
+/* be load tested on machines with no display or GPU.       */
+/* Spawns M asteroids, sets off K explosions spread evenly  */
+/* over N ticks and reports throughput and memory use.      */
+/*                                                          */
+/* Usage: headless [-t ticks] [-a asteroids] [-e explosions]*/
+/*                 [-s seed] [-k scalar|sse2|avx2]          */
+/*                 [-g 0|1] [-z 0|1] [-c clicks]            */
+/*                 [-x none|bounce|fragment]                */
+/*                 [-j threads] [-b chunk] [-p chunk]       */
+/*                 [-r WxH] [-o frame.ppm|frame.png]        */
+/*                 [-i session.rec | -R session.rec]        */
+/*                 [-l snapshot] [-w snapshot]              */
+/*                 [-f frames.csv] [-B particles] [-T ms]   */
+/*                 [-C checksums.txt]                       */
+/*                                                          */
+/*   -g  look clicks up through the spatial grid (default)  */
+/*       or by walking every asteroid                       */
+/*   -z  grow the field with the asteroid count so density  */
+/*       matches the default 12 asteroids on a 4x3 field    */
+/*   -c  after the run, time this many clicks at random     */
+/*       points (hit test only, nothing explodes)           */
+/*   -x  what asteroids do when they collide                */
+/*   -j  threads for the per-tick step (0 = one per core)   */
+/*   -b  asteroids per chunk of parallel work               */
+/*   -p  particle systems per chunk of parallel work        */
+/*   -r  rasterize every tick in software at this size and  */
+/*       report the cost per frame                          */
+/*   -o  save the last frame (1920x1080 unless -r is given) */
+/*   -i  replay a session recorded by the windowed game     */
+/*       instead (-t, -a, -e, -s and -z are ignored)        */
+/*   -R  record the run as a session, starting the way the  */
+/*       window does (-a and -z are ignored). Explosions    */
+/*       become clicks on the window, recorded and applied  */
+/*       as the window's simulation thread does. Replaying  */
+/*       the session with -i (and the same -x, -B and -k)   */
+/*       must end on the same checksum.                     */
+/*   -l  start from a saved world instead of -a asteroids   */
+/*   -w  save the world after the run                      */
+/*   -f  time every phase of every tick, print min/avg/p99  */
+/*       and save the times as CSV                          */
+/*   -B  cap on live particles (0 = none, default 150000)   */
+/*   -T  particle step time to scale new explosions down to */
+/*       (0 = off, the default; runs are then repeatable)   */
+/*   -C  write the world's checksum after every tick, one   */
+/*       line per tick, so runs on two builds or machines   */
+/*       can be diffed down to the first tick they differ.  */
+/*       Build with -DFIXED_POINT for runs that match bit   */
+/*       for bit across compilers and CPUs.                 */
+/************************************************************/
+
+#define HEADLESS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <type_traits>
+
+#include "Graphics.h"
+#include "Asteroid.h"
+#include "World.h"
+#include "Clock.h"
+#include "SoftwareRenderer.h"
+#include "Input.h"
+#include "Snapshot.h"
+#include "Profiler.h"
+
+using namespace Graphics;
+
+struct Options
+{
+  int      ticks;
+  int      asteroids;
+  int      explosions;
+  unsigned seed;
+
+  ParticleKernels::Path kernel;
+
+  bool use_grid;
+  bool scale_field;
+  int  clicks;
+
+  CollisionMode collisions;
+
+  int threads;
+  int asteroid_chunk;
+  int particle_chunk;
+
+  int         frame_width;  // 0 when frames are not rendered every tick
+  int         frame_height;
+  const char *frame_path;   // NULL when no frame is saved
+
+  const char *replay_path;  // NULL unless replaying a session
+  const char *record_path;  // NULL unless recording one
+
+  const char *load_path;    // Snapshot to start from, or NULL
+  const char *save_path;    // Snapshot to write at the end, or NULL
+
+  const char *profile_path; // Per-tick phase times, or NULL
+
+  const char *checksum_path; // Per-tick checksums, or NULL
+
+  int    particle_cap;
+  double particle_target_ms;
+};
+
+// Peak resident set size of this process, in kilobytes
+long peak_memory_kb()
+{
+  rusage usage;
+  getrusage( RUSAGE_SELF, &usage );
+
+  return( usage.ru_maxrss );
+}
+
+void print_pool( const char *name, unsigned long hits, unsigned long misses )
+{
+  printf( "%-16s %lu hits, %lu misses\n", name, hits, misses );
+}
+
+bool parse_options( int argc, char **argv, Options &options )
+{
+  options.ticks      = 1000;
+  options.asteroids  = 1000;
+  options.explosions = 100;
+  options.seed       = 1;
+  options.kernel     = ParticleKernels::best_path();
+  options.use_grid    = true;
+  options.scale_field = false;
+  options.clicks      = 0;
+  options.collisions  = COLLIDE_BOUNCE;
+  options.threads        = 0;
+  options.asteroid_chunk = 1024;
+  options.particle_chunk = 1;
+  options.frame_width    = 0;
+  options.frame_height   = 0;
+  options.frame_path     = NULL;
+  options.replay_path    = NULL;
+  options.record_path    = NULL;
+  options.load_path      = NULL;
+  options.save_path      = NULL;
+  options.profile_path   = NULL;
+  options.checksum_path  = NULL;
+  options.particle_cap       = ParticleBudget().max_particles;
+  options.particle_target_ms = 0;
+
+  for( int i = 1; i < argc; i++ )
+  {
+    if( i + 1 >= argc ) return( false );
+
+    if( strcmp( argv[i], "-t" ) == 0 )
+      options.ticks = atoi( argv[++i] );
+    else if( strcmp( argv[i], "-a" ) == 0 )
+      options.asteroids = atoi( argv[++i] );
+    else if( strcmp( argv[i], "-e" ) == 0 )
+      options.explosions = atoi( argv[++i] );
+    else if( strcmp( argv[i], "-s" ) == 0 )
+      options.seed = strtoul( argv[++i], NULL, 10 );
+    else if( strcmp( argv[i], "-k" ) == 0 )
+    {
+      i++;
+      if( strcmp( argv[i], "scalar" ) == 0 )    options.kernel = ParticleKernels::SCALAR;
+      else if( strcmp( argv[i], "sse2" ) == 0 ) options.kernel = ParticleKernels::SSE2;
+      else if( strcmp( argv[i], "avx2" ) == 0 ) options.kernel = ParticleKernels::AVX2;
+      else return( false );
+    }
+    else if( strcmp( argv[i], "-g" ) == 0 )
+      options.use_grid = atoi( argv[++i] ) != 0;
+    else if( strcmp( argv[i], "-z" ) == 0 )
+      options.scale_field = atoi( argv[++i] ) != 0;
+    else if( strcmp( argv[i], "-c" ) == 0 )
+      options.clicks = atoi( argv[++i] );
+    else if( strcmp( argv[i], "-x" ) == 0 )
+    {
+      i++;
+      if( strcmp( argv[i], "none" ) == 0 )          options.collisions = COLLIDE_NONE;
+      else if( strcmp( argv[i], "bounce" ) == 0 )   options.collisions = COLLIDE_BOUNCE;
+      else if( strcmp( argv[i], "fragment" ) == 0 ) options.collisions = COLLIDE_FRAGMENT;
+      else return( false );
+    }
+    else if( strcmp( argv[i], "-j" ) == 0 )
+      options.threads = atoi( argv[++i] );
+    else if( strcmp( argv[i], "-b" ) == 0 )
+      options.asteroid_chunk = atoi( argv[++i] );
+    else if( strcmp( argv[i], "-p" ) == 0 )
+      options.particle_chunk = atoi( argv[++i] );
+    else if( strcmp( argv[i], "-r" ) == 0 )
+    {
+      if( sscanf( argv[++i], "%dx%d", &options.frame_width, &options.frame_height ) != 2 ||
+          options.frame_width <= 0 || options.frame_height <= 0 )
+        return( false );
+    }
+    else if( strcmp( argv[i], "-o" ) == 0 )
+      options.frame_path = argv[++i];
+    else if( strcmp( argv[i], "-i" ) == 0 )
+      options.replay_path = argv[++i];
+    else if( strcmp( argv[i], "-R" ) == 0 )
+      options.record_path = argv[++i];
+    else if( strcmp( argv[i], "-l" ) == 0 )
+      options.load_path = argv[++i];
+    else if( strcmp( argv[i], "-w" ) == 0 )
+      options.save_path = argv[++i];
+    else if( strcmp( argv[i], "-f" ) == 0 )
+      options.profile_path = argv[++i];
+    else if( strcmp( argv[i], "-B" ) == 0 )
+      options.particle_cap = atoi( argv[++i] );
+    else if( strcmp( argv[i], "-T" ) == 0 )
+      options.particle_target_ms = atof( argv[++i] );
+    else if( strcmp( argv[i], "-C" ) == 0 )
+      options.checksum_path = argv[++i];
+    else
+      return( false );
+  }
+
+  // A recording starts from a fresh world, like the window's
+  if( options.record_path != NULL && ( options.replay_path != NULL || options.load_path != NULL ) )
+    return( false );
+
+  return( options.ticks > 0 && options.asteroids >= 0 && options.explosions >= 0 &&
+          options.particle_cap >= 0 && options.particle_target_ms >= 0 &&
+          options.threads >= 0 && options.asteroid_chunk > 0 && options.particle_chunk > 0 );
+}
+
+int main( int argc, char **argv )
+{
+  Options options;
+  if( !parse_options( argc, argv, options ) )
+  {
+    fprintf( stderr, "usage: %s [-t ticks] [-a asteroids] [-e explosions] [-s seed] [-k scalar|sse2|avx2]\n"
+                     "       [-g 0|1] [-z 0|1] [-c clicks] [-x none|bounce|fragment]\n"
+                     "       [-j threads] [-b chunk] [-p chunk] [-r WxH] [-o frame.ppm|frame.png]\n"
+                     "       [-i session.rec | -R session.rec] [-l snapshot] [-w snapshot] [-f frames.csv]\n"
+                     "       [-B particles] [-T ms] [-C checksums.txt]\n", argv[0] );
+    return( 1 );
+  }
+
+  InputLog input;
+  if( options.replay_path != NULL )
+  {
+    if( !input.load( options.replay_path ) )
+    {
+      fprintf( stderr, "could not read a session from %s\n", options.replay_path );
+      return( 1 );
+    }
+
+    // Start the way the windowed game does, and run exactly as long
+    options.seed        = unsigned( input.seed );
+    options.asteroids   = 12;
+    options.explosions  = 0;
+    options.scale_field = false;
+    options.ticks       = input.length > 0 ? int( input.length ) : 1;
+  }
+  else if( options.record_path != NULL )
+  {
+    input.start( options.seed );
+
+    options.asteroids   = 12;
+    options.scale_field = false;
+  }
+
+  if( !ParticleKernels::use_path( options.kernel ) )
+  {
+    fprintf( stderr, "this CPU cannot run the %s particle kernel\n", ParticleKernels::path_name( options.kernel ) );
+    return( 1 );
+  }
+
+  World world;
+  world.seed( options.replay_path != NULL || options.record_path != NULL ? input.seed : options.seed );
+  world.use_grid       = options.use_grid;
+  world.collision_mode = options.collisions;
+  world.asteroid_chunk = options.asteroid_chunk;
+  world.particle_chunk = options.particle_chunk;
+  world.pool.resize( options.threads );
+  world.budget.max_particles = options.particle_cap;
+  world.budget.target_ms     = options.particle_target_ms;
+
+  if( options.scale_field && options.asteroids > 12 )
+  {
+    float scale = sqrtf( options.asteroids / 12.0f );
+
+    world.ratio[0] *= scale;
+    world.ratio[1] *= scale;
+  }
+
+  double load_time = 0;
+
+  if( options.load_path != NULL )
+  {
+    double load_start = now_in_seconds();
+
+    if( !Snapshot::load( world, options.load_path ) )
+    {
+      fprintf( stderr, "could not load a snapshot from %s\n", options.load_path );
+      return( 1 );
+    }
+
+    load_time = now_in_seconds() - load_start;
+  }
+  else
+    world.reset( options.asteroids );
+
+  Profiler profiler( options.ticks );
+  if( options.profile_path != NULL )
+    world.profiler = &profiler;
+
+  Controls controls( world );
+  auto     play_events = [&]( const InputEvent *events, int count )
+  {
+    Profiler::Scope scope( world.profiler, Profiler::INPUT );
+    controls.apply_all( events, count );
+  };
+
+  // Explosions are spread evenly over the run, each one set off by
+  // clicking on the most recently added asteroid. When recording, the
+  // clicks of a tick are recorded at window positions and applied as
+  // one batch, and nothing is spawned outside of the session.
+  int    explosions_left = options.explosions;
+  double interval        = options.explosions > 0 ? double(options.ticks) / options.explosions : 0;
+  double next_explosion  = 0;
+
+  int peak_asteroids = 0;
+  int peak_particles = 0;
+
+  CollisionStats collisions; // Summed over every tick
+  double         step_time = 0;
+
+  SoftwareRenderer frame( options.frame_width > 0 ? options.frame_width : 1920,
+                          options.frame_height > 0 ? options.frame_height : 1080 );
+  frame.pool = &world.pool;
+
+  double build_time  = 0;
+  double raster_time = 0;
+
+  FILE *checksums = NULL;
+  if( options.checksum_path != NULL && ( checksums = fopen( options.checksum_path, "w" ) ) == NULL )
+  {
+    fprintf( stderr, "could not write %s\n", options.checksum_path );
+    return( 1 );
+  }
+
+  double start = now_in_seconds();
+
+  for( int t = 0; t < options.ticks; t++ )
+  {
+    size_t recorded = input.events.size();
+
+    while( explosions_left > 0 && t >= next_explosion )
+    {
+      Profiler::Scope scope( world.profiler, Profiler::INPUT );
+
+      if( world.asteroids.isEmpty() && options.record_path == NULL )
+        world.spawn( 1 );
+
+      if( !world.asteroids.isEmpty() )
+      {
+        Point<> target = to_float( world.asteroids[ world.asteroids.size() - 1 ].location );
+
+        if( options.record_path != NULL )
+        {
+          int x, y;
+          controls.window_point( target, x, y );
+          input.record( INPUT_CLICK, 0, x, y );
+        }
+        else
+          world.click( target );
+      }
+
+      explosions_left--;
+      next_explosion += interval;
+    }
+
+    if( input.events.size() > recorded )
+      play_events( &input.events[ recorded ], int( input.events.size() - recorded ) );
+
+    input.play( play_events );
+    world.update();
+    input.step();
+
+    step_time += world.step_time;
+
+    if( checksums != NULL )
+      fprintf( checksums, "%d %016llx\n", t + 1, (unsigned long long)world.checksum() );
+
+    if( options.frame_width > 0 )
+    {
+      Profiler::Scope scope( world.profiler, Profiler::DRAW );
+
+      frame.draw( world, 1 );
+
+      build_time  += frame.build_time;
+      raster_time += frame.raster_time;
+    }
+
+    collisions.grid_candidates += world.collision_stats.grid_candidates;
+    collisions.broad_pairs     += world.collision_stats.broad_pairs;
+    collisions.contacts        += world.collision_stats.contacts;
+    collisions.grid_time       += world.collision_stats.grid_time;
+    collisions.broad_time      += world.collision_stats.broad_time;
+    collisions.narrow_time     += world.collision_stats.narrow_time;
+    collisions.response_time   += world.collision_stats.response_time;
+
+    if( world.asteroids.size() > peak_asteroids )
+      peak_asteroids = world.asteroids.size();
+
+    int particles = world.particle_count();
+    if( particles > peak_particles )
+      peak_particles = particles;
+
+    profiler.end_frame();
+  }
+
+  // Events that came in after the last step of the recording
+  input.play( play_events );
+
+  double elapsed = now_in_seconds() - start;
+
+  if( checksums != NULL )
+    fclose( checksums );
+
+  if( options.record_path != NULL && !input.save( options.record_path ) )
+    fprintf( stderr, "could not write %s\n", options.record_path );
+
+  if( options.frame_path != NULL )
+  {
+    if( options.frame_width == 0 )
+      frame.draw( world, 1 );
+
+    if( !frame.write( options.frame_path ) )
+      fprintf( stderr, "could not write %s\n", options.frame_path );
+  }
+
+  double save_time = 0;
+
+  if( options.save_path != NULL )
+  {
+    double save_start = now_in_seconds();
+
+    if( !Snapshot::save( world, options.save_path ) )
+      fprintf( stderr, "could not write %s\n", options.save_path );
+
+    save_time = now_in_seconds() - save_start;
+  }
+
+  // Click latency: time picks at random points on the field
+  double click_time = 0;
+  int    click_hits = 0;
+
+  if( options.clicks > 0 )
+  {
+    Random<> r( options.seed );
+    Point<>  p;
+
+    world.refresh_grid();
+
+    double click_start = now_in_seconds();
+    for( int i = 0; i < options.clicks; i++ )
+    {
+      p.x = r.next( -world.ratio[0] / 2, world.ratio[0] / 2 );
+      p.y = r.next( -world.ratio[1] / 2, world.ratio[1] / 2 );
+
+      if( world.pick( p ) >= 0 )
+        click_hits++;
+    }
+    click_time = now_in_seconds() - click_start;
+  }
+
+  printf( "physics          %s\n",   std::is_same< Real, Fixed >::value ? "Q16.16 fixed point" : "float" );
+  printf( "particle kernel  %s\n",   ParticleKernels::path_name( options.kernel ) );
+  printf( "threads          %d\n",   world.pool.size() );
+  printf( "ticks            %d\n",   options.ticks );
+  printf( "elapsed          %.3f s\n", elapsed );
+  printf( "ticks/sec        %.1f\n", options.ticks / elapsed );
+  printf( "explosions       %lu\n",  world.explosions );
+  printf( "asteroids        %d (peak %d)\n", world.asteroids.size(), peak_asteroids );
+  printf( "particle systems %d\n",   world.particles.size() );
+  printf( "particles        %d (peak %d)\n", world.particle_count(), peak_particles );
+  printf( "particle budget  cap %d, density %.2f, %lu systems (%lu shrunk), %lu retired early\n",
+          world.budget.max_particles, world.budget.density, world.budget.spawned, world.budget.shrunk,
+          world.budget.retired );
+  printf( "peak memory      %ld KB\n", peak_memory_kb() );
+  printf( "checksum         %016llx\n", (unsigned long long)world.checksum() );
+
+  if( options.load_path != NULL )
+    printf( "snapshot load    %.3f ms from %s\n", load_time * 1e3, options.load_path );
+
+  if( options.save_path != NULL )
+    printf( "snapshot save    %.3f ms to %s\n", save_time * 1e3, options.save_path );
+
+  if( options.replay_path != NULL )
+    printf( "replay           %d events from %s\n", int( input.events.size() ), options.replay_path );
+
+  if( options.record_path != NULL )
+    printf( "recorded         %d events to %s\n", int( input.events.size() ), options.record_path );
+
+  printf( "step time        %.3f ms per tick (%lu chunks, %lu steals)\n",
+          step_time / options.ticks * 1e3, world.pool.chunks, world.pool.steals );
+
+  if( options.collisions != COLLIDE_NONE )
+  {
+    int t = options.ticks;
+
+    printf( "collision pairs  %.1f grid, %.1f broad, %.1f contacts per tick\n",
+            double( collisions.grid_candidates ) / t, double( collisions.broad_pairs ) / t, double( collisions.contacts ) / t );
+    printf( "collision time   %.3f grid + %.3f broad + %.3f narrow + %.3f response ms per tick\n",
+            collisions.grid_time / t * 1e3, collisions.broad_time / t * 1e3,
+            collisions.narrow_time / t * 1e3, collisions.response_time / t * 1e3 );
+  }
+
+  if( options.frame_width > 0 )
+    printf( "frame time       %.3f build + %.3f raster ms per %dx%d frame\n",
+            build_time / options.ticks * 1e3, raster_time / options.ticks * 1e3,
+            options.frame_width, options.frame_height );
+
+  if( options.profile_path != NULL )
+  {
+    printf( "phase ms         %9s %9s %9s\n", "min", "avg", "p99" );
+
+    for( int p = 0; p <= Profiler::PHASE_COUNT; p++ )
+    {
+      Profiler::Summary summary = profiler.summarize( p );
+
+      printf( "  %-14s %9.3f %9.3f %9.3f\n", p < Profiler::PHASE_COUNT ? Profiler::phase_name( p ) : "tick",
+              summary.min, summary.avg, summary.p99 );
+    }
+
+    if( !profiler.write_csv( options.profile_path ) )
+      fprintf( stderr, "could not write %s\n", options.profile_path );
+  }
+
+  if( options.clicks > 0 )
+    printf( "click latency    %.3f us (%s, %d of %d hit)\n", click_time / options.clicks * 1e6,
+            options.use_grid ? "grid" : "linear", click_hits, options.clicks );
+
+  // Asteroids and particle systems live by value in the World's
+  // stores, so their particle buffers are the one pool left to report
+  print_pool( "particle buffers", ArrayPool<float>::shared().hits, ArrayPool<float>::shared().misses );
+
+  ShapeLibrary &shapes = ShapeLibrary::shared();
+  printf( "shape library    %d shapes in %d classes, %lu KB\n", shapes.shape_count(), shapes.class_count(),
+          (unsigned long)( shapes.memory_used() / 1024 ) );
+
+  return( 0 );
+}
@@ -0,0 +1,449 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <atomic>
+#include <vector>
+
+#include "World.h"
+#include "Clock.h"
+#include "SpscQueue.h"
+
+namespace Graphics
+{
+  enum InputType { INPUT_RESIZE, INPUT_CLICK, INPUT_KEY };
+
+  // One thing the player did, stamped with how many steps had run
+  struct InputEvent
+  {
+    uint32_t tick;
+    uint8_t  type; // An InputType
+    uint8_t  code; // Mouse button or key
+    int16_t  x, y; // Mouse position, or the new window size
+  };
+
+  /* What the player can do to a World through the window: resize    */
+  /* it (which reshapes the field), click on it and press keys. The   */
+  /* GLUT front end and the headless replay both go through here, so  */
+  /* a recorded session plays back the same way in either.            */
+  class Controls
+  {
+  public:
+    World *world;
+    int    window_size[2]; // In pixels { w, h }
+    int    asteroids;      // How many a reset starts with
+
+    Controls( World &world )
+    {
+      this->world          = &world;
+      this->window_size[0] = 1000;
+      this->window_size[1] = 750;
+      this->asteroids      = 12;
+    }
+
+    void apply( const InputEvent &event )
+    {
+      switch( event.type )
+      {
+        case INPUT_RESIZE: this->resize( event.x, event.y ); break;
+        case INPUT_CLICK:  this->click( event.x, event.y );  break;
+        case INPUT_KEY:    this->key( event.code );          break;
+      }
+    }
+
+    // Applies a batch of events in order, except that each run of
+    // clicks goes to the world together (see World::click_all)
+    void apply_all( const InputEvent *events, int count )
+    {
+      this->clicks.clear();
+
+      for( int i = 0; i <= count; i++ )
+      {
+        if( i < count && events[i].type == INPUT_CLICK )
+        {
+          this->clicks.push_back( this->field_point( events[i].x, events[i].y ) );
+          continue;
+        }
+
+        if( !this->clicks.empty() )
+        {
+          this->world->click_all( &this->clicks[0], int( this->clicks.size() ) );
+          this->clicks.clear();
+        }
+
+        if( i < count )
+          this->apply( events[i] );
+      }
+    }
+
+    // The field keeps a height (or width, if the window is taller than
+    // wide) of 2 and stretches the other way with the window
+    void resize( int w, int h )
+    {
+      this->window_size[0] = w;
+      this->window_size[1] = h;
+
+      float *ratio = this->world->ratio;
+
+      if( w <= h )
+      {
+        ratio[0] = 2.0f;
+        ratio[1] = 2.0f * h / w;
+      }
+      else
+      {
+        ratio[0] = 2.0f * w / h;
+        ratio[1] = 2.0f;
+      }
+    }
+
+    // Explodes the first asteroid under a window position
+    void click( int x, int y )
+    {
+      this->world->click( this->field_point( x, y ) );
+    }
+
+    // Where a window position falls on the field
+    Point<> field_point( int x, int y ) const
+    {
+      float *ratio = this->world->ratio;
+
+      return( Point<>( ratio[0] * x / this->window_size[0] - 0.5f * ratio[0],
+                       0.5f * ratio[1] - ratio[1] * y / this->window_size[1] ) );
+    }
+
+    // The window pixel over a point on the field, the other way round
+    void window_point( Point<> p, int &x, int &y ) const
+    {
+      float *ratio = this->world->ratio;
+
+      x = int( floorf( ( p.x + 0.5f * ratio[0] ) * this->window_size[0] / ratio[0] + .5f ) );
+      y = int( floorf( ( 0.5f * ratio[1] - p.y ) * this->window_size[1] / ratio[1] + .5f ) );
+    }
+
+    void key( unsigned char key )
+    {
+      switch( tolower( key ) )
+      {
+        case 'r': this->world->reset( this->asteroids ); break;
+        case 'p': this->world->toggle_pause();           break;
+      }
+    }
+
+  private:
+    std::vector< Point<> > clicks; // A run of clicks in apply_all()
+  };
+
+  /* Live input on its way from the window's thread to the            */
+  /* simulation's. The window's callbacks only stamp an event with    */
+  /* the time and push it onto a lock-free queue; the simulation      */
+  /* drains whatever is waiting at the start of a step and applies it */
+  /* as one batch, so input never changes the world in the middle of  */
+  /* a step or a frame. If the simulation falls so far behind that    */
+  /* the queue fills, further events are dropped and counted.         */
+  /*                                                                  */
+  /* How deep the queue got and how long events waited (from the      */
+  /* callback to the drain) are kept as metrics, which either thread  */
+  /* may read.                                                        */
+  class InputQueue
+  {
+  public:
+    InputQueue( uint32_t capacity = 256 ) : queue( capacity )
+    {
+      this->event_count.store( 0 );
+      this->batch_count.store( 0 );
+      this->deepest.store( 0 );
+      this->latency_total.store( 0 );
+      this->latency_max.store( 0 );
+    }
+
+    // Window thread: queues an event, stamped with the time. Returns
+    // false if the queue was full and the event was dropped.
+    bool post( InputType type, int code, int x, int y )
+    {
+      Queued queued;
+      queued.event.tick = 0; // Stamped when it is recorded
+      queued.event.type = uint8_t( type );
+      queued.event.code = uint8_t( code );
+      queued.event.x    = int16_t( x );
+      queued.event.y    = int16_t( y );
+      queued.time       = now_in_seconds();
+
+      return( this->queue.push( queued ) );
+    }
+
+    // Simulation thread: hands take() every event waiting, oldest
+    // first, and returns how many there were
+    template< typename F >
+    int drain( F take )
+    {
+      double now   = now_in_seconds();
+      int    depth = this->queue.size();
+
+      if( depth > this->deepest.load( std::memory_order_relaxed ) )
+        this->deepest.store( depth, std::memory_order_relaxed );
+
+      Queued queued;
+      int    count = 0;
+
+      while( count < depth && this->queue.pop( queued ) )
+      {
+        double waited = now - queued.time;
+
+        this->latency_total.store( this->latency_total.load( std::memory_order_relaxed ) + waited, std::memory_order_relaxed );
+        if( waited > this->latency_max.load( std::memory_order_relaxed ) )
+          this->latency_max.store( waited, std::memory_order_relaxed );
+
+        take( queued.event );
+        count++;
+      }
+
+      if( count > 0 )
+      {
+        this->event_count.store( this->event_count.load( std::memory_order_relaxed ) + count, std::memory_order_relaxed );
+        this->batch_count.store( this->batch_count.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+      }
+
+      return( count );
+    }
+
+    // Events waiting now
+    int depth() const { return( this->queue.size() ); }
+
+    // Most events ever found waiting at a drain
+    int max_depth() const { return( this->deepest.load( std::memory_order_relaxed ) ); }
+
+    unsigned long events()  const { return( this->event_count.load( std::memory_order_relaxed ) ); }
+    unsigned long batches() const { return( this->batch_count.load( std::memory_order_relaxed ) ); }
+    unsigned long dropped() const { return( this->queue.dropped_count() ); }
+
+    // Seconds from posting to draining, over every event drained
+    double average_latency() const
+    {
+      unsigned long events = this->events();
+
+      return( events > 0 ? this->latency_total.load( std::memory_order_relaxed ) / events : 0 );
+    }
+
+    double max_latency() const
+    {
+      return( this->latency_max.load( std::memory_order_relaxed ) );
+    }
+
+  private:
+    struct Queued
+    {
+      InputEvent event;
+      double     time; // When it was posted
+    };
+
+    SpscQueue<Queued> queue;
+
+    // Written by the simulation thread only
+    std::atomic<unsigned long> event_count;
+    std::atomic<unsigned long> batch_count;
+    std::atomic<int>           deepest;
+    std::atomic<double>        latency_total;
+    std::atomic<double>        latency_max;
+  };
+
+  /* A played session: the seed the run started from and every input  */
+  /* event in order, each stamped with the number of steps that had   */
+  /* run when it arrived. Starting a World from the same seed and     */
+  /* applying the events stamped with a step, as one batch, just      */
+  /* before that step reproduces the session exactly, however fast    */
+  /* frames were drawn.                                               */
+  /*                                                                  */
+  /* On disk it is a 24 byte header (magic, version, seed, length in  */
+  /* steps, event count) and 12 bytes per event, all little endian.   */
+  /* Version 1 sessions were recorded applying events one at a time   */
+  /* and are played back that way.                                    */
+  class InputLog
+  {
+  public:
+    uint64_t      seed;
+    unsigned long tick;   // Steps taken since start() or load()
+    unsigned long length; // Steps the loaded session ran for
+    uint32_t      version; // Of the loaded session, or the current one
+
+    std::vector<InputEvent> events;
+
+    InputLog()
+    {
+      this->start( 0 );
+    }
+
+    // Begins a new recording
+    void start( uint64_t seed )
+    {
+      this->seed    = seed;
+      this->tick    = 0;
+      this->length  = 0;
+      this->next    = 0;
+      this->version = VERSION;
+
+      this->events.clear();
+    }
+
+    // Adds an event at the current step and returns it, to be applied
+    // by the caller. It counts as played, so play() does not hand it
+    // out a second time.
+    const InputEvent &record( InputType type, int code, int x, int y )
+    {
+      InputEvent event;
+      event.tick = uint32_t( this->tick );
+      event.type = uint8_t( type );
+      event.code = uint8_t( code );
+      event.x    = int16_t( x );
+      event.y    = int16_t( y );
+
+      this->events.push_back( event );
+      this->next = this->events.size();
+
+      return( this->events.back() );
+    }
+
+    // Hands apply( events, count ) every event that is due before the
+    // next step, as one batch (as batches of one for version 1)
+    template< typename F >
+    void play( F apply )
+    {
+      size_t first = this->next;
+
+      while( this->next < this->events.size() && this->events[ this->next ].tick <= this->tick )
+        this->next++;
+
+      if( this->next == first ) return;
+
+      if( this->version < 2 )
+        for( size_t i = first; i < this->next; i++ )
+          apply( &this->events[i], 1 );
+      else
+        apply( &this->events[ first ], int( this->next - first ) );
+    }
+
+    void step()
+    {
+      this->tick++;
+    }
+
+    // Whether a loaded session still has steps to run
+    bool is_playing() const
+    {
+      return( this->tick < this->length );
+    }
+
+    bool save( const char *path ) const
+    {
+      FILE *file = fopen( path, "wb" );
+      if( file == NULL ) return( false );
+
+      unsigned char header[ HEADER_SIZE ];
+      memcpy( header, "ASTI", 4 );
+      put( header + 4,  this->version, 4 );
+      put( header + 8,  this->seed, 8 );
+      put( header + 16, this->tick, 4 );
+      put( header + 20, this->events.size(), 4 );
+
+      fwrite( header, 1, HEADER_SIZE, file );
+
+      for( size_t i = 0; i < this->events.size(); i++ )
+      {
+        const InputEvent &event = this->events[i];
+        unsigned char bytes[ EVENT_SIZE ];
+
+        put( bytes,     event.tick, 4 );
+        put( bytes + 4, event.type, 1 );
+        put( bytes + 5, event.code, 1 );
+        put( bytes + 6, uint16_t( event.x ), 2 );
+        put( bytes + 8, uint16_t( event.y ), 2 );
+        put( bytes + 10, 0, 2 );
+
+        fwrite( bytes, 1, EVENT_SIZE, file );
+      }
+
+      return( fclose( file ) == 0 );
+    }
+
+    // Reads a session back for playing. Leaves the log empty and
+    // returns false if the file is missing, not a session, or not as
+    // long as its header says.
+    bool load( const char *path )
+    {
+      this->start( 0 );
+
+      FILE *file = fopen( path, "rb" );
+      if( file == NULL ) return( false );
+
+      unsigned char header[ HEADER_SIZE ];
+      bool ok = fread( header, 1, HEADER_SIZE, file ) == HEADER_SIZE &&
+                memcmp( header, "ASTI", 4 ) == 0 && get( header + 4, 4 ) >= 1 && get( header + 4, 4 ) <= VERSION;
+
+      // The event count is only trusted once the file is exactly as
+      // long as that many events make it, so a truncated or damaged
+      // header cannot ask for a huge allocation
+      uint64_t count = ok ? get( header + 20, 4 ) : 0;
+
+      ok = ok && fseek( file, 0, SEEK_END ) == 0 && ftell( file ) == long( HEADER_SIZE + count * EVENT_SIZE ) &&
+           fseek( file, long( HEADER_SIZE ), SEEK_SET ) == 0;
+
+      if( ok )
+      {
+        this->version = uint32_t( get( header + 4, 4 ) );
+        this->seed    = get( header + 8, 8 );
+        this->length  = (unsigned long)get( header + 16, 4 );
+        this->events.resize( size_t( count ) );
+
+        for( size_t i = 0; ok && i < this->events.size(); i++ )
+        {
+          InputEvent    &event = this->events[i];
+          unsigned char  bytes[ EVENT_SIZE ];
+
+          ok = fread( bytes, 1, EVENT_SIZE, file ) == EVENT_SIZE;
+
+          event.tick = uint32_t( get( bytes, 4 ) );
+          event.type = bytes[4];
+          event.code = bytes[5];
+          event.x    = int16_t( uint16_t( get( bytes + 6, 2 ) ) );
+          event.y    = int16_t( uint16_t( get( bytes + 8, 2 ) ) );
+        }
+      }
+
+      fclose( file );
+
+      if( !ok )
+        this->start( 0 );
+
+      return( ok );
+    }
+
+  private:
+    static const uint32_t VERSION     = 2;
+    static const size_t   HEADER_SIZE = 24;
+    static const size_t   EVENT_SIZE  = 12;
+
+    size_t next; // First event not yet played
+
+    static void put( unsigned char *out, uint64_t value, int bytes )
+    {
+      for( int i = 0; i < bytes; i++ )
+        out[i] = (unsigned char)( value >> ( 8 * i ) );
+    }
+
+    static uint64_t get( const unsigned char *in, int bytes )
+    {
+      uint64_t value = 0;
+
+      for( int i = 0; i < bytes; i++ )
+        value |= uint64_t( in[i] ) << ( 8 * i );
+
+      return( value );
+    }
+  };
+}
+
+#endif
@@ -14,6 +14,8 @@
 #include <stdlib.h>
 #include <assert.h>
 
+#include "Pool.h"
+
 ////////////////////////////////////////////////////////
 // DECLARATION SECTION FOR LINKED LIST CLASS TEMPLATE //
 ////////////////////////////////////////////////////////
@@ -52,6 +54,17 @@ template <class E> class LinkedList
 			E data;
 			nodePtr next;
 			nodePtr previous;
+
+			// Nodes are recycled through a free list
+			static void *operator new(size_t)
+			{
+				return Graphics::Pool<node>::shared().allocate();
+			}
+
+			static void operator delete(void *p)
+			{
+				Graphics::Pool<node>::shared().release(p);
+			}
 		};
 
 		nodePtr head;
@@ -0,0 +1,297 @@
+/************************************************************/
+/* Filename: MathBench.cpp                                  */
+/* Checks the FastMath approximations and their FixedMath   */
+/* (Q16.16 integer) counterparts against libm: the worst    */
+/* error over a dense sweep of inputs, and how many         */
+/* nanoseconds each call takes next to its libm equivalent. */
+/* Then runs every particle kernel the CPU supports from    */
+/* the same seeded particles and checks they agree with the */
+/* scalar one; exits with 1 if any differ.                  */
+/*                                                          */
+/* Usage: mathbench [-n calls]                              */
+/************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#include "FastMath.h"
+#include "Fixed.h"
+#include "ParticleKernels.h"
+#include "Clock.h"
+
+using namespace Graphics;
+
+// Keeps the optimizer from throwing the benchmarked work away
+volatile float g_sink;
+
+struct Error
+{
+  double worst;
+  double at;
+
+  Error()
+  {
+    this->worst = this->at = 0;
+  }
+
+  void add( double error, double input )
+  {
+    if( error > this->worst )
+    {
+      this->worst = error;
+      this->at    = input;
+    }
+  }
+};
+
+// Inputs for the timing loops: a fixed spread, so both sides see the
+// same values and none of them are trivially cheap
+const int INPUTS = 4096;
+float g_angles[ INPUTS ];
+float g_x[ INPUTS ];
+float g_y[ INPUTS ];
+float g_positive[ INPUTS ];
+Fixed g_fixed_angles[ INPUTS ];
+Fixed g_fixed_x[ INPUTS ];
+Fixed g_fixed_y[ INPUTS ];
+Fixed g_fixed_positive[ INPUTS ];
+
+void make_inputs()
+{
+  unsigned s = 12345;
+
+  for( int i = 0; i < INPUTS; i++ )
+  {
+    s = s * 1664525u + 1013904223u;
+    float u = ( s >> 8 ) * ( 1.0f / 16777216.0f );
+
+    s = s * 1664525u + 1013904223u;
+    float v = ( s >> 8 ) * ( 1.0f / 16777216.0f );
+
+    g_angles[i]   = ( u - .5f ) * 40;
+    g_x[i]        = u * 2 - 1;
+    g_y[i]        = v * 2 - 1;
+    g_positive[i] = u * 100 + 1e-3f;
+
+    g_fixed_angles[i]   = Fixed( g_angles[i] );
+    g_fixed_x[i]        = Fixed( g_x[i] );
+    g_fixed_y[i]        = Fixed( g_y[i] );
+    g_fixed_positive[i] = Fixed( g_positive[i] );
+  }
+}
+
+template< typename F >
+double time_per_call( long calls, F f )
+{
+  float  sum   = 0;
+  double start = now_in_seconds();
+
+  for( long i = 0; i < calls; i++ )
+    sum += f( int( i & ( INPUTS - 1 ) ) );
+
+  double elapsed = now_in_seconds() - start;
+  g_sink = sum;
+
+  return( elapsed / calls * 1e9 );
+}
+
+void report( const char *name, Error error, const char *kind, double fast_ns, double libm_ns )
+{
+  printf( "%-8s max %s error %.2e (at %.6g)   %.2f ns vs libm %.2f ns (%.1fx)\n",
+          name, kind, error.worst, error.at, fast_ns, libm_ns, libm_ns / fast_ns );
+}
+
+// Particles for the kernel check: an odd count so the SIMD paths run
+// their scalar tail, and positions and speeds like a real burst's
+const int   KERNEL_PARTICLES = 1003;
+const int   KERNEL_STEPS     = 500;
+const float KERNEL_CHAOS     = .5f / 50;
+
+// Widest a kernel's position may be from the scalar one's. The paths
+// do the same float operations in the same order, but the compiler
+// may fuse the scalar multiply-adds, which moves the last bit.
+const double KERNEL_TOLERANCE = 1e-4;
+
+struct KernelRun
+{
+  std::vector<float> x, y, vx, vy, out;
+  unsigned int       lanes[ ParticleKernels::LANES ];
+
+  KernelRun()
+  {
+    unsigned int s = 2463534242u;
+
+    this->x.resize( KERNEL_PARTICLES );
+    this->y.resize( KERNEL_PARTICLES );
+    this->vx.resize( KERNEL_PARTICLES );
+    this->vy.resize( KERNEL_PARTICLES );
+    this->out.resize( 2 * KERNEL_PARTICLES );
+
+    for( int i = 0; i < KERNEL_PARTICLES; i++ )
+    {
+      s = ParticleKernels::xorshift( s ); this->x[i]  = 2 + ParticleKernels::jitter( s, 2 );
+      s = ParticleKernels::xorshift( s ); this->y[i]  = 1.5f + ParticleKernels::jitter( s, 1.5f );
+      s = ParticleKernels::xorshift( s ); this->vx[i] = ParticleKernels::jitter( s, .02f );
+      s = ParticleKernels::xorshift( s ); this->vy[i] = ParticleKernels::jitter( s, .02f );
+    }
+
+    for( int i = 0; i < ParticleKernels::LANES; i++ )
+      this->lanes[i] = ParticleKernels::xorshift( s += i ) | 1;
+  }
+
+  void run( ParticleKernels::Path path )
+  {
+    ParticleKernels::StepFunction step = ParticleKernels::step_function( path );
+
+    for( int i = 0; i < KERNEL_STEPS; i++ )
+      step( this->x.data(), this->y.data(), this->vx.data(), this->vy.data(), KERNEL_PARTICLES,
+            this->lanes, KERNEL_CHAOS, this->out.data() );
+  }
+};
+
+// Returns false if a path's particles, packed output or random lanes
+// part from the scalar path's
+bool check_kernels()
+{
+  KernelRun scalar;
+  scalar.run( ParticleKernels::SCALAR );
+
+  bool ok = true;
+
+  for( int p = ParticleKernels::SSE2; p <= ParticleKernels::AVX2; p++ )
+  {
+    ParticleKernels::Path path = ParticleKernels::Path( p );
+
+    if( !ParticleKernels::supports( path ) )
+    {
+      printf( "%-8s not supported by this CPU, skipped\n", ParticleKernels::path_name( path ) );
+      continue;
+    }
+
+    KernelRun run;
+    run.run( path );
+
+    Error error;
+    bool  lanes_match = memcmp( run.lanes, scalar.lanes, sizeof( run.lanes ) ) == 0;
+
+    for( int i = 0; i < KERNEL_PARTICLES; i++ )
+    {
+      error.add( fabs( run.x[i] - scalar.x[i] ), i );
+      error.add( fabs( run.y[i] - scalar.y[i] ), i );
+      error.add( fabs( run.out[ 2*i ] - run.x[i] ), i );
+      error.add( fabs( run.out[ 2*i + 1 ] - run.y[i] ), i );
+    }
+
+    bool agrees = lanes_match && error.worst <= KERNEL_TOLERANCE;
+
+    printf( "%-8s max abs difference from scalar %.2e (at particle %.0f) after %d steps, lanes %s   %s\n",
+            ParticleKernels::path_name( path ), error.worst, error.at, KERNEL_STEPS,
+            lanes_match ? "match" : "differ", agrees ? "ok" : "FAILED" );
+
+    ok = ok && agrees;
+  }
+
+  return( ok );
+}
+
+int main( int argc, char **argv )
+{
+  long calls = 20000000;
+
+  if( argc == 3 && strcmp( argv[1], "-n" ) == 0 )
+    calls = atol( argv[2] );
+  else if( argc != 1 )
+  {
+    fprintf( stderr, "usage: %s [-n calls]\n", argv[0] );
+    return( 1 );
+  }
+
+  make_inputs();
+
+  // Accuracy sweeps
+  Error sin_error, cos_error, atan2_error, rsqrt_error;
+
+  for( double a = -1e4; a <= 1e4; a += 1e-3 )
+  {
+    float s, c, angle = float( a );
+    FastMath::sincos( angle, s, c );
+
+    sin_error.add( fabs( s - sin( double( angle ) ) ), angle );
+    cos_error.add( fabs( c - cos( double( angle ) ) ), angle );
+  }
+
+  for( int i = 0; i < 4000; i++ )
+    for( int j = 0; j < 4000; j++ )
+    {
+      float x = ( i - 2000 ) / 997.0f;
+      float y = ( j - 2000 ) / 991.0f;
+
+      atan2_error.add( fabs( FastMath::atan2( y, x ) - atan2( double( y ), double( x ) ) ), atan2( double( y ), double( x ) ) );
+    }
+
+  for( double x = 1e-30; x < 1e30; x *= 1.0000123 )
+  {
+    float  f     = float( x );
+    double exact = 1 / sqrt( double( f ) );
+
+    rsqrt_error.add( fabs( FastMath::rsqrt( f ) - exact ) / exact, f );
+  }
+
+  // Timing
+  double fast_sincos = time_per_call( calls, []( int i ) { float s, c; FastMath::sincos( g_angles[i], s, c ); return( s + c ); } );
+  double libm_sincos = time_per_call( calls, []( int i ) { return( sinf( g_angles[i] ) + cosf( g_angles[i] ) ); } );
+
+  double fast_atan2 = time_per_call( calls, []( int i ) { return( FastMath::atan2( g_y[i], g_x[i] ) ); } );
+  double libm_atan2 = time_per_call( calls, []( int i ) { return( atan2f( g_y[i], g_x[i] ) ); } );
+
+  double fast_rsqrt = time_per_call( calls, []( int i ) { return( FastMath::rsqrt( g_positive[i] ) ); } );
+  double libm_rsqrt = time_per_call( calls, []( int i ) { return( 1 / sqrtf( g_positive[i] ) ); } );
+
+  Error sincos_error = sin_error.worst > cos_error.worst ? sin_error : cos_error;
+
+  report( "sincos", sincos_error, "abs", fast_sincos, libm_sincos );
+  report( "atan2",  atan2_error,  "abs", fast_atan2,  libm_atan2 );
+  report( "rsqrt",  rsqrt_error,  "rel", fast_rsqrt,  libm_rsqrt );
+
+  // The fixed point versions, over every angle and length a Fixed
+  // can hold, against libm on the exact values they stand for
+  Error fixed_sincos_error, fixed_atan2_error, fixed_sqrt_error;
+
+  for( int64_t raw = INT32_MIN; raw <= INT32_MAX; raw += 997 )
+  {
+    Fixed  s, c, angle = Fixed::from_raw( int32_t( raw ) );
+    double exact = raw / 65536.0;
+    FixedMath::sincos( angle, s, c );
+
+    fixed_sincos_error.add( fabs( s.to_float() - sin( exact ) ), exact );
+    fixed_sincos_error.add( fabs( c.to_float() - cos( exact ) ), exact );
+
+    if( raw >= 0 )
+      fixed_sqrt_error.add( fabs( FixedMath::sqrt( angle ).to_float() - sqrt( exact ) ), exact );
+  }
+
+  for( int i = 0; i < 4000; i++ )
+    for( int j = 0; j < 4000; j++ )
+    {
+      Fixed x = Fixed( ( i - 2000 ) / 997.0 );
+      Fixed y = Fixed( ( j - 2000 ) / 991.0 );
+
+      double exact = atan2( double( y.to_float() ), double( x.to_float() ) );
+
+      fixed_atan2_error.add( fabs( FixedMath::atan2( y, x ).to_float() - exact ), exact );
+    }
+
+  double fixed_sincos = time_per_call( calls, []( int i ) { Fixed s, c; FixedMath::sincos( g_fixed_angles[i], s, c ); return( ( s + c ).to_float() ); } );
+  double fixed_atan2  = time_per_call( calls, []( int i ) { return( FixedMath::atan2( g_fixed_y[i], g_fixed_x[i] ).to_float() ); } );
+  double fixed_sqrt   = time_per_call( calls, []( int i ) { return( FixedMath::sqrt( g_fixed_positive[i] ).to_float() ); } );
+  double libm_sqrt    = time_per_call( calls, []( int i ) { return( sqrtf( g_positive[i] ) ); } );
+
+  report( "Fsincos", fixed_sincos_error, "abs", fixed_sincos, libm_sincos );
+  report( "Fatan2",  fixed_atan2_error,  "abs", fixed_atan2,  libm_atan2 );
+  report( "Fsqrt",   fixed_sqrt_error,   "abs", fixed_sqrt,   libm_sqrt );
+
+  return( check_kernels() ? 0 : 1 );
+}
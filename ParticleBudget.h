@@ -0,0 +1,132 @@
+#ifndef PARTICLE_BUDGET_H
+#define PARTICLE_BUDGET_H
+
+namespace Graphics
+{
+  /* Keeps explosions affordable however many go off at once. There   */
+  /* are two limits:                                                  */
+  /*                                                                  */
+  /*   max_particles  a cap on live particles. A new system is made   */
+  /*                  smaller to fit under it, down to min_density    */
+  /*                  of a full one; if it still doesn't fit, the     */
+  /*                  oldest systems are retired early to make room.  */
+  /*   target_ms      a time to keep the per-tick particle step       */
+  /*                  under. Going over scales the density (particle  */
+  /*                  count) of new systems down; staying well under  */
+  /*                  lets it creep back up to 1.                     */
+  /*                                                                  */
+  /* Either way a new system is full size or a multiple of the        */
+  /* smallest one, so the pooled particle buffers keep fitting.       */
+  /*                                                                  */
+  /* The cap depends only on the simulation, so runs stay repeatable. */
+  /* The time target depends on the machine, so it is off (0) unless  */
+  /* asked for, and must stay off when recording or replaying.        */
+  class ParticleBudget
+  {
+  public:
+    static const int SIZES = 10; // Most sizes below full a new system comes in
+
+    int    max_particles; // 0 for no cap
+    double target_ms;     // 0 to ignore time
+    int    full_count;    // Particles in a full density system
+    float  min_density;
+
+    float density; // Scale for new systems, in [min_density, 1]
+
+    // Stats
+    int           live;       // Particles alive after the last tick
+    int           peak;
+    double        step_ms;    // Particle step time of the last tick
+    unsigned long spawned;    // Systems created
+    unsigned long shrunk;     // Systems created smaller than full
+    unsigned long retired;    // Systems ended early to make room
+
+    ParticleBudget()
+    {
+      this->max_particles = 150000;
+      this->target_ms     = 0;
+      this->full_count    = 1500;
+      this->min_density   = .1f;
+      this->density       = 1;
+
+      this->reset_stats();
+    }
+
+    void reset_stats()
+    {
+      this->live    = this->peak = 0;
+      this->step_ms = 0;
+      this->spawned = this->shrunk = this->retired = 0;
+    }
+
+    // Particles for a new system, given how many are alive already.
+    // The caller retires systems until "live" plus this fits. Anything
+    // short of full_count is rounded down to a multiple of
+    // least_count(), so systems come in a handful of sizes and their
+    // pooled particle buffers are reused rather than each squeezed
+    // system asking the heap for a length no other system has.
+    int count_for( int live ) const
+    {
+      int count = int( this->full_count * this->density + .5f );
+      int least = this->least_count();
+
+      if( this->max_particles > 0 && live + count > this->max_particles )
+        count = this->max_particles - live;
+
+      if( count < this->full_count )
+        count -= count % least;
+
+      return( count < least ? least : count );
+    }
+
+    // Smallest system, and the step sizes go up in: min_density of a
+    // full one, but never under 1 / SIZES of it, which keeps the sizes
+    // to SIZES + 1 at most
+    int least_count() const
+    {
+      int least = int( this->full_count * this->min_density + .5f );
+      int step  = ( this->full_count + SIZES - 1 ) / SIZES;
+
+      if( least < step ) least = step;
+      return( least < 1 ? 1 : least );
+    }
+
+    // Whether "count" more particles fit with "live" already alive
+    bool fits( int live, int count ) const
+    {
+      return( this->max_particles <= 0 || live + count <= this->max_particles );
+    }
+
+    void spawned_system( int count )
+    {
+      this->spawned++;
+
+      if( count < this->full_count )
+        this->shrunk++;
+    }
+
+    // Takes in a finished tick: the particles alive and how long their
+    // step took. Multiplicative decrease, additive increase, so a burst
+    // is answered quickly and density recovers without oscillating.
+    void observe( int live, double step_seconds )
+    {
+      this->live    = live;
+      this->step_ms = step_seconds * 1e3;
+
+      if( live > this->peak )
+        this->peak = live;
+
+      if( this->target_ms <= 0 ) return;
+
+      if( this->step_ms > this->target_ms )
+        this->density *= .8f;
+      else if( this->step_ms < .75 * this->target_ms )
+        this->density += .02f;
+
+      if( this->density < this->min_density ) this->density = this->min_density;
+      if( this->density > 1 )                 this->density = 1;
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,289 @@
+#ifndef PARTICLE_KERNELS_H
+#define PARTICLE_KERNELS_H
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+  #define PARTICLE_KERNELS_X86
+  #include <immintrin.h>
+#endif
+
+namespace Graphics
+{
+  /* Batch kernels that advance a structure-of-arrays particle system */
+  /* by one step and write the new positions into a packed x,y        */
+  /* vertex array. The chaos jitter comes from eight xorshift32 lanes */
+  /* (particle i uses lane i % 8), so the scalar, SSE2 and AVX2 paths */
+  /* all consume the same random stream and produce the same output.  */
+  namespace ParticleKernels
+  {
+    const int LANES = 8;
+
+    enum Path
+    {
+      SCALAR,
+      SSE2,
+      AVX2
+    };
+
+    typedef void (*StepFunction)( float *x, float *y, const float *vx, const float *vy, int n,
+                                  unsigned int *lanes, float chaos, float *out );
+
+    inline unsigned int xorshift( unsigned int s )
+    {
+      s ^= s << 13;
+      s ^= s >> 17;
+      s ^= s << 5;
+
+      return( s );
+    }
+
+    // Maps the top 24 bits of a lane state onto [-chaos, chaos)
+    inline float jitter( unsigned int s, float chaos )
+    {
+      return( float( s >> 8 ) * ( 1.0f / 16777216.0f ) * ( 2 * chaos ) - chaos );
+    }
+
+    inline void step_scalar( float *x, float *y, const float *vx, const float *vy, int n,
+                             unsigned int *lanes, float chaos, float *out )
+    {
+      for( int i = 0; i < n; i++ )
+      {
+        unsigned int s = lanes[ i % LANES ];
+
+        s = xorshift( s );
+        x[i] = ( x[i] + vx[i] ) + jitter( s, chaos );
+
+        s = xorshift( s );
+        y[i] = ( y[i] + vy[i] ) + jitter( s, chaos );
+
+        lanes[ i % LANES ] = s;
+
+        if( out )
+        {
+          out[ 2*i ]     = x[i];
+          out[ 2*i + 1 ] = y[i];
+        }
+      }
+    }
+
+    // Writes the positions "trail" steps behind each particle into out
+    inline void emit( const float *x, const float *y, const float *vx, const float *vy, int n,
+                      float trail, float *out )
+    {
+      for( int i = 0; i < n; i++ )
+      {
+        out[ 2*i ]     = x[i] - vx[i] * trail;
+        out[ 2*i + 1 ] = y[i] - vy[i] * trail;
+      }
+    }
+
+    // Writes one line segment per particle into out, from "from" steps
+    // behind it to "to" steps behind it
+    inline void emit_segments( const float *x, const float *y, const float *vx, const float *vy, int n,
+                               float from, float to, float *out )
+    {
+      for( int i = 0; i < n; i++ )
+      {
+        out[ 4*i ]     = x[i] - vx[i] * from;
+        out[ 4*i + 1 ] = y[i] - vy[i] * from;
+        out[ 4*i + 2 ] = x[i] - vx[i] * to;
+        out[ 4*i + 3 ] = y[i] - vy[i] * to;
+      }
+    }
+
+#ifdef PARTICLE_KERNELS_X86
+    __attribute__(( target( "sse2" ) ))
+    inline __m128i xorshift_sse2( __m128i s )
+    {
+      s = _mm_xor_si128( s, _mm_slli_epi32( s, 13 ) );
+      s = _mm_xor_si128( s, _mm_srli_epi32( s, 17 ) );
+      s = _mm_xor_si128( s, _mm_slli_epi32( s, 5 ) );
+
+      return( s );
+    }
+
+    __attribute__(( target( "sse2" ) ))
+    inline __m128 jitter_sse2( __m128i s, __m128 scale, __m128 chaos )
+    {
+      __m128 u = _mm_mul_ps( _mm_cvtepi32_ps( _mm_srli_epi32( s, 8 ) ), _mm_set1_ps( 1.0f / 16777216.0f ) );
+
+      return( _mm_sub_ps( _mm_mul_ps( u, scale ), chaos ) );
+    }
+
+    // Four lanes per instruction, two registers per group of eight
+    __attribute__(( target( "sse2" ) ))
+    inline void step_sse2( float *x, float *y, const float *vx, const float *vy, int n,
+                           unsigned int *lanes, float chaos, float *out )
+    {
+      __m128  c     = _mm_set1_ps( chaos );
+      __m128  scale = _mm_set1_ps( 2 * chaos );
+      __m128i s[2]  = { _mm_loadu_si128( (__m128i*)lanes ), _mm_loadu_si128( (__m128i*)( lanes + 4 ) ) };
+
+      int i = 0;
+      for( ; i + LANES <= n; i += LANES )
+      {
+        for( int h = 0; h < 2; h++ )
+        {
+          int j = i + 4*h;
+
+          s[h] = xorshift_sse2( s[h] );
+          __m128 px = _mm_add_ps( _mm_add_ps( _mm_loadu_ps( x + j ), _mm_loadu_ps( vx + j ) ), jitter_sse2( s[h], scale, c ) );
+
+          s[h] = xorshift_sse2( s[h] );
+          __m128 py = _mm_add_ps( _mm_add_ps( _mm_loadu_ps( y + j ), _mm_loadu_ps( vy + j ) ), jitter_sse2( s[h], scale, c ) );
+
+          _mm_storeu_ps( x + j, px );
+          _mm_storeu_ps( y + j, py );
+
+          if( out )
+          {
+            _mm_storeu_ps( out + 2*j,     _mm_unpacklo_ps( px, py ) );
+            _mm_storeu_ps( out + 2*j + 4, _mm_unpackhi_ps( px, py ) );
+          }
+        }
+      }
+
+      _mm_storeu_si128( (__m128i*)lanes,         s[0] );
+      _mm_storeu_si128( (__m128i*)( lanes + 4 ), s[1] );
+
+      // i is a multiple of LANES, so the tail keeps using lane i % 8
+      step_scalar( x + i, y + i, vx + i, vy + i, n - i, lanes, chaos, out ? out + 2*i : 0 );
+    }
+
+    __attribute__(( target( "avx2" ) ))
+    inline __m256i xorshift_avx2( __m256i s )
+    {
+      s = _mm256_xor_si256( s, _mm256_slli_epi32( s, 13 ) );
+      s = _mm256_xor_si256( s, _mm256_srli_epi32( s, 17 ) );
+      s = _mm256_xor_si256( s, _mm256_slli_epi32( s, 5 ) );
+
+      return( s );
+    }
+
+    __attribute__(( target( "avx2" ) ))
+    inline __m256 jitter_avx2( __m256i s, __m256 scale, __m256 chaos )
+    {
+      __m256 u = _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_srli_epi32( s, 8 ) ), _mm256_set1_ps( 1.0f / 16777216.0f ) );
+
+      return( _mm256_sub_ps( _mm256_mul_ps( u, scale ), chaos ) );
+    }
+
+    // Eight lanes per instruction
+    __attribute__(( target( "avx2" ) ))
+    inline void step_avx2( float *x, float *y, const float *vx, const float *vy, int n,
+                           unsigned int *lanes, float chaos, float *out )
+    {
+      __m256  c     = _mm256_set1_ps( chaos );
+      __m256  scale = _mm256_set1_ps( 2 * chaos );
+      __m256i s     = _mm256_loadu_si256( (__m256i*)lanes );
+
+      int i = 0;
+      for( ; i + LANES <= n; i += LANES )
+      {
+        s = xorshift_avx2( s );
+        __m256 px = _mm256_add_ps( _mm256_add_ps( _mm256_loadu_ps( x + i ), _mm256_loadu_ps( vx + i ) ), jitter_avx2( s, scale, c ) );
+
+        s = xorshift_avx2( s );
+        __m256 py = _mm256_add_ps( _mm256_add_ps( _mm256_loadu_ps( y + i ), _mm256_loadu_ps( vy + i ) ), jitter_avx2( s, scale, c ) );
+
+        _mm256_storeu_ps( x + i, px );
+        _mm256_storeu_ps( y + i, py );
+
+        if( out )
+        {
+          // unpack interleaves within each 128 bit half, permute puts
+          // the halves back in particle order
+          __m256 lo = _mm256_unpacklo_ps( px, py );
+          __m256 hi = _mm256_unpackhi_ps( px, py );
+
+          _mm256_storeu_ps( out + 2*i,     _mm256_permute2f128_ps( lo, hi, 0x20 ) );
+          _mm256_storeu_ps( out + 2*i + 8, _mm256_permute2f128_ps( lo, hi, 0x31 ) );
+        }
+      }
+
+      _mm256_storeu_si256( (__m256i*)lanes, s );
+
+      step_scalar( x + i, y + i, vx + i, vy + i, n - i, lanes, chaos, out ? out + 2*i : 0 );
+    }
+#endif
+
+    // Whether the running CPU can run a path
+    inline bool supports( Path path )
+    {
+#ifdef PARTICLE_KERNELS_X86
+      __builtin_cpu_init();
+
+      switch( path )
+      {
+        case AVX2: return( __builtin_cpu_supports( "avx2" ) );
+        case SSE2: return( __builtin_cpu_supports( "sse2" ) );
+        default:   return( true );
+      }
+#else
+      return( path == SCALAR );
+#endif
+    }
+
+    // Fastest path the running CPU supports
+    inline Path best_path()
+    {
+      if( supports( AVX2 ) ) return( AVX2 );
+      if( supports( SSE2 ) ) return( SSE2 );
+
+      return( SCALAR );
+    }
+
+    inline StepFunction step_function( Path path )
+    {
+#ifdef PARTICLE_KERNELS_X86
+      switch( path )
+      {
+        case AVX2: return( step_avx2 );
+        case SSE2: return( step_sse2 );
+        default:   break;
+      }
+#endif
+      return( step_scalar );
+    }
+
+    inline const char *path_name( Path path )
+    {
+      switch( path )
+      {
+        case AVX2: return( "avx2" );
+        case SSE2: return( "sse2" );
+        default:   return( "scalar" );
+      }
+    }
+
+    inline Path &path_slot()
+    {
+      static Path path = best_path();
+      return( path );
+    }
+
+    // The path used by step(); picked once at startup
+    inline Path current_path()
+    {
+      return( path_slot() );
+    }
+
+    // Forces a path (e.g. SCALAR) for comparisons. A path the CPU
+    // cannot run is refused, leaving the current one in place, so a
+    // bad choice fails here rather than as an illegal instruction.
+    inline bool use_path( Path path )
+    {
+      if( !supports( path ) ) return( false );
+
+      path_slot() = path;
+      return( true );
+    }
+
+    inline void step( float *x, float *y, const float *vx, const float *vy, int n,
+                      unsigned int *lanes, float chaos, float *out )
+    {
+      step_function( current_path() )( x, y, vx, vy, n, lanes, chaos, out );
+    }
+  }
+}
+
+#endif
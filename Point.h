@@ -1,64 +1,72 @@
 #ifndef POINT_H
 #define POINT_H
 
-#include <cmath>
+#include "VectorMath.h"
+#include "Fixed.h"
 
 namespace Graphics
 {
+  /* A position in the plane. Point<> holds floats and is a float2    */
+  /* (everything in VectorMath.h works on it, and an array of them is */
+  /* an array of x,y floats). Point<Fixed> is the same for the fixed  */
+  /* point physics, with just the operators that needs.               */
   template< typename T = float >
   class Point
   {
   public:
     T x, y;
 
-    Point()
-    {
-      this->x = this->y = NULL;
-    }
+    constexpr Point() : x(), y() {}
+    constexpr Point( T x, T y ) : x( x ), y( y ) {}
 
-    Point( T x, T y )
-    {
-      this->x = x;
-      this->y = y;
-    }
+    constexpr Point operator+( Point p ) const { return( Point( this->x + p.x, this->y + p.y ) ); }
+    constexpr Point operator-( Point p ) const { return( Point( this->x - p.x, this->y - p.y ) ); }
+    constexpr Point operator-() const          { return( Point( -this->x, -this->y ) ); }
+    constexpr Point operator*( T s ) const     { return( Point( this->x * s, this->y * s ) ); }
 
-    T distance_from( Point p )
-    {
-      return( sqrt( pow( p.x - this->x, 2) + pow( p.y - this->y, 2 ) ) );
-    }
+    Point &operator+=( Point p ) { this->x += p.x; this->y += p.y; return( *this ); }
+    Point &operator-=( Point p ) { this->x -= p.x; this->y -= p.y; return( *this ); }
 
-    T *to_array()
-    {
-      T a[] = { this->x, this->y };
-      return( a );
-    }
+    constexpr bool operator==( Point p ) const { return( this->x == p.x && this->y == p.y ); }
+    constexpr bool operator!=( Point p ) const { return( !( *this == p ) ); }
 
-	  Point operator+( Point p )
-	  {
-      return( Point( this->x + p.x, this->y + p.y ) );
-    }
+    T distance_from( Point p ) const
+    {
+      Point d = p - *this;
 
-	  Point operator-( Point p )
-	  {
-      return( Point( this->x - p.x, this->y - p.y ) );
+      return( Numeric::sqrt( d.x * d.x + d.y * d.y ) );
     }
+  };
 
-	  Point& operator+=( Point p )
-	  { 
-      this->x += p.x;
-      this->y += p.y;
-      
-      return( *this );
-    }
+  template<>
+  class Point<float> : public float2
+  {
+  public:
+    constexpr Point() : float2() {}
+    constexpr Point( float x, float y ) : float2( x, y ) {}
+    constexpr Point( float2 p ) : float2( p ) {}
 
-	  Point& operator-=( Point p )
-	  { 
-      this->x -= p.x;
-      this->y -= p.y;
-      
-      return( *this );
+    float distance_from( Point p ) const
+    {
+      return( distance( *this, p ) );
     }
   };
+
+  static_assert( sizeof( Point<> ) == sizeof( float2 ), "an array of Point<> is an array of float2" );
+
+  // A point of either kind as floats, for drawing and the float
+  // collision tests
+  template< typename T >
+  constexpr Point<> to_float( Point<T> p )
+  {
+    return( Point<>( to_float( p.x ), to_float( p.y ) ) );
+  }
+
+  // A float point in the physics' number type
+  inline Point<Real> to_real( Point<> p )
+  {
+    return( Point<Real>( Real( p.x ), Real( p.y ) ) );
+  }
 }
 
-#endif
\ No newline at end of file
+#endif
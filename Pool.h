@@ -0,0 +1,262 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <new>
+
+namespace Graphics
+{
+  /* A free list of blocks big enough for one T. Released blocks are  */
+  /* kept and handed out again instead of going back to the heap, so  */
+  /* once a pool has warmed up, churning objects does no allocation.  */
+  /* Classes opt in by routing their operator new/delete through it.  */
+  template< typename T >
+  class Pool
+  {
+  public:
+    unsigned long hits;   // Requests served from the free list
+    unsigned long misses; // Requests that had to go to the heap
+
+    Pool()
+    {
+      this->free_list = NULL;
+      this->hits = this->misses = 0;
+    }
+
+    void *allocate()
+    {
+      if( this->free_list == NULL )
+      {
+        this->misses++;
+        return( ::operator new( sizeof( Block ) ) );
+      }
+
+      this->hits++;
+
+      Block *block    = this->free_list;
+      this->free_list = block->next;
+
+      return( block );
+    }
+
+    void release( void *p )
+    {
+      if( p == NULL ) return;
+
+      Block *block    = (Block*)p;
+      block->next     = this->free_list;
+      this->free_list = block;
+    }
+
+    // The shared pool is never destroyed, so objects can still be
+    // released into it while other globals are being torn down
+    static Pool &shared()
+    {
+      static Pool *pool = new Pool();
+      return( *pool );
+    }
+
+  private:
+    union Block
+    {
+      Block *next;
+      char   data[ sizeof( T ) ];
+    };
+
+    Block *free_list;
+  };
+
+  /* A free list of arrays of T, bucketed by length. Each array is    */
+  /* preceded by a small header that remembers its length, so it can  */
+  /* be released with just the pointer, like delete []. When no array */
+  /* of the exact length is free, the shortest longer one is handed   */
+  /* out instead; it keeps its length and returns to its own bucket.  */
+  template< typename T >
+  class ArrayPool
+  {
+  public:
+    unsigned long hits;
+    unsigned long misses;
+
+    ArrayPool()
+    {
+      this->bucket_count = 0;
+      this->hits = this->misses = 0;
+    }
+
+    // Returns an array of (at least) n default initialized T's
+    T *acquire( int n )
+    {
+      Bucket *bucket = this->find_free( n );
+      Header *header;
+
+      if( bucket != NULL && bucket->free_list != NULL )
+      {
+        this->hits++;
+
+        header            = bucket->free_list;
+        bucket->free_list = header->next;
+      }
+      else
+      {
+        this->misses++;
+
+        header         = (Header*)::operator new( sizeof( Header ) + n * sizeof( T ) );
+        header->length = n;
+      }
+
+      T *items = (T*)( header + 1 );
+      for( int i = 0; i < n; i++ )
+        new ( items + i ) T;
+
+      return( items );
+    }
+
+    void release( T *items )
+    {
+      if( items == NULL ) return;
+
+      Header *header = (Header*)items - 1;
+      Bucket *bucket = this->find( header->length );
+
+      // Too many distinct lengths to track; give this one back
+      if( bucket == NULL && this->bucket_count == MAX_BUCKETS )
+      {
+        ::operator delete( header );
+        return;
+      }
+
+      if( bucket == NULL )
+      {
+        bucket            = &this->buckets[ this->bucket_count++ ];
+        bucket->length    = header->length;
+        bucket->free_list = NULL;
+      }
+
+      header->next      = bucket->free_list;
+      bucket->free_list = header;
+    }
+
+    static ArrayPool &shared()
+    {
+      static ArrayPool *pool = new ArrayPool();
+      return( *pool );
+    }
+
+  private:
+    // 16 bytes on 64 bit targets, which keeps the array SIMD aligned
+    struct Header
+    {
+      Header *next;
+      long    length;
+    };
+
+    struct Bucket
+    {
+      long    length;
+      Header *free_list;
+    };
+
+    enum { MAX_BUCKETS = 16 };
+
+    Bucket buckets[ MAX_BUCKETS ];
+    int    bucket_count;
+
+    Bucket *find( long length )
+    {
+      for( int i = 0; i < this->bucket_count; i++ )
+        if( this->buckets[i].length == length )
+          return( &this->buckets[i] );
+
+      return( NULL );
+    }
+
+    // The bucket with the shortest free arrays that hold n, or NULL
+    Bucket *find_free( long n )
+    {
+      Bucket *best = NULL;
+
+      for( int i = 0; i < this->bucket_count; i++ )
+      {
+        Bucket &bucket = this->buckets[i];
+
+        if( bucket.free_list != NULL && bucket.length >= n && ( best == NULL || bucket.length < best->length ) )
+          best = &bucket;
+      }
+
+      return( best );
+    }
+  };
+
+  /* Owns one array from the shared ArrayPool<T> and gives it back    */
+  /* when destroyed. It can be moved but not copied, so classes that  */
+  /* hold one can live by value in containers that relocate them.     */
+  template< typename T >
+  class PooledArray
+  {
+  public:
+    PooledArray()
+    {
+      this->items = NULL;
+    }
+
+    explicit PooledArray( int n )
+    {
+      this->items = ArrayPool<T>::shared().acquire( n );
+    }
+
+    PooledArray( PooledArray &&other )
+    {
+      this->items = other.items;
+      other.items = NULL;
+    }
+
+    PooledArray &operator=( PooledArray &&other )
+    {
+      if( this != &other )
+      {
+        this->release();
+
+        this->items = other.items;
+        other.items = NULL;
+      }
+
+      return( *this );
+    }
+
+    ~PooledArray()
+    {
+      this->release();
+    }
+
+    void acquire( int n )
+    {
+      this->release();
+      this->items = ArrayPool<T>::shared().acquire( n );
+    }
+
+    void release()
+    {
+      ArrayPool<T>::shared().release( this->items );
+      this->items = NULL;
+    }
+
+    T *get()
+    {
+      return( this->items );
+    }
+
+    T &operator[]( int i )
+    {
+      return( this->items[i] );
+    }
+
+  private:
+    PooledArray( const PooledArray & );
+    PooledArray &operator=( const PooledArray & );
+
+    T *items;
+  };
+}
+
+#endif
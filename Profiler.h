@@ -0,0 +1,209 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "Clock.h"
+
+namespace Graphics
+{
+  /* Where each frame's time goes. Code wraps a phase of the frame in */
+  /* a Profiler::Scope; the time adds up into the current frame's row */
+  /* (a phase can run several times a frame, like a step when the     */
+  /* timestep catches up) and end_frame() commits the row to a ring   */
+  /* of the last "capacity" frames.                                   */
+  /*                                                                  */
+  /* One thread records. Each time in the ring is a relaxed atomic,   */
+  /* and committing a row is a release store of the frame count, so   */
+  /* other threads can read the ring without locking; they may just   */
+  /* see the oldest row part way through being overwritten. Only one  */
+  /* thread at a time may call summarize(), which sorts in a buffer   */
+  /* the Profiler keeps.                                              */
+  class Profiler
+  {
+  public:
+    enum Phase { INPUT, ASTEROIDS, COLLISIONS, PARTICLES, DRAW, SWAP, PHASE_COUNT };
+
+    struct Summary
+    {
+      double min, avg, p99; // Milliseconds
+    };
+
+    // Times a phase from construction to destruction. A NULL profiler
+    // makes it free, so code can be instrumented unconditionally.
+    class Scope
+    {
+    public:
+      Scope( Profiler *profiler, Phase phase )
+      {
+        this->profiler = profiler;
+        this->phase    = phase;
+        this->start    = profiler ? now_in_seconds() : 0;
+      }
+
+      ~Scope()
+      {
+        if( this->profiler )
+          this->profiler->add( this->phase, now_in_seconds() - this->start );
+      }
+
+    private:
+      Profiler *profiler;
+      Phase     phase;
+      double    start;
+    };
+
+    Profiler( int capacity = 600 )
+    {
+      this->capacity = capacity;
+      this->rows = std::vector< std::atomic<float> >( size_t( capacity ) * PHASE_COUNT );
+      this->frames.store( 0 );
+
+      this->clear_current();
+    }
+
+    static const char *phase_name( int phase )
+    {
+      static const char *names[ PHASE_COUNT ] = { "input", "asteroids", "collisions", "particles", "draw", "swap" };
+      return( names[ phase ] );
+    }
+
+    void add( Phase phase, double seconds )
+    {
+      this->current[ phase ] += float( seconds * 1e3 );
+    }
+
+    // Commits the phases timed since the last call as one frame
+    void end_frame()
+    {
+      uint64_t            frame = this->frames.load( std::memory_order_relaxed );
+      std::atomic<float> *row   = &this->rows[ size_t( frame % this->capacity ) * PHASE_COUNT ];
+
+      for( int p = 0; p < PHASE_COUNT; p++ )
+        row[p].store( this->current[p], std::memory_order_relaxed );
+
+      this->frames.store( frame + 1, std::memory_order_release );
+      this->clear_current();
+    }
+
+    // Frames ever committed; the ring holds the last "capacity" of them
+    uint64_t frame_count() const
+    {
+      return( this->frames.load( std::memory_order_acquire ) );
+    }
+
+    int stored() const
+    {
+      uint64_t first;
+      return( this->window( first ) );
+    }
+
+    // Min, mean and 99th percentile of a phase over the stored frames.
+    // Pass PHASE_COUNT for the whole frame. Not to be called from two
+    // threads at once: the samples are sorted in "scratch".
+    Summary summarize( int phase ) const
+    {
+      Summary summary = { 0, 0, 0 };
+
+      uint64_t first;
+      int      n = this->window( first );
+      if( n == 0 ) return( summary );
+
+      this->scratch.resize( n );
+
+      for( int f = 0; f < n; f++ )
+        this->scratch[f] = this->value( first + f, phase );
+
+      double sum = 0;
+      summary.min = this->scratch[0];
+
+      for( int f = 0; f < n; f++ )
+      {
+        sum += this->scratch[f];
+        if( this->scratch[f] < summary.min ) summary.min = this->scratch[f];
+      }
+
+      std::vector<float>::iterator p99 = this->scratch.begin() + ( n - 1 ) * 99 / 100;
+      std::nth_element( this->scratch.begin(), p99, this->scratch.end() );
+
+      summary.avg = sum / n;
+      summary.p99 = *p99;
+
+      return( summary );
+    }
+
+    // One line per stored frame, oldest first, times in milliseconds
+    bool write_csv( const char *path ) const
+    {
+      FILE *file = fopen( path, "w" );
+      if( file == NULL ) return( false );
+
+      fprintf( file, "frame" );
+      for( int p = 0; p < PHASE_COUNT; p++ )
+        fprintf( file, ",%s_ms", phase_name( p ) );
+      fprintf( file, ",total_ms\n" );
+
+      uint64_t first;
+      int      n = this->window( first );
+
+      for( int f = 0; f < n; f++ )
+      {
+        fprintf( file, "%llu", (unsigned long long)( first + f ) );
+
+        for( int p = 0; p <= PHASE_COUNT; p++ )
+          fprintf( file, ",%.4f", this->value( first + f, p ) );
+
+        fprintf( file, "\n" );
+      }
+
+      return( fclose( file ) == 0 );
+    }
+
+  private:
+    int                               capacity;
+    std::vector< std::atomic<float> > rows;    // capacity rows of PHASE_COUNT times
+    std::atomic<uint64_t>             frames;
+    float                             current[ PHASE_COUNT ]; // The recording thread's own
+
+    mutable std::vector<float> scratch; // summarize()'s
+
+    Profiler( const Profiler & );
+    Profiler &operator=( const Profiler & );
+
+    void clear_current()
+    {
+      for( int p = 0; p < PHASE_COUNT; p++ )
+        this->current[p] = 0;
+    }
+
+    // How many frames the ring holds, and the number of the oldest
+    int window( uint64_t &first ) const
+    {
+      uint64_t frames = this->frame_count();
+      int      n      = int( frames < uint64_t( this->capacity ) ? frames : this->capacity );
+
+      first = frames - n;
+      return( n );
+    }
+
+    // A phase (or the total, for PHASE_COUNT) of a stored frame
+    float value( uint64_t frame, int phase ) const
+    {
+      const std::atomic<float> *row = &this->rows[ size_t( frame % this->capacity ) * PHASE_COUNT ];
+
+      if( phase < PHASE_COUNT ) return( row[ phase ].load( std::memory_order_relaxed ) );
+
+      float total = 0;
+      for( int p = 0; p < PHASE_COUNT; p++ )
+        total += row[p].load( std::memory_order_relaxed );
+
+      return( total );
+    }
+  };
+}
+
+#endif
@@ -5,18 +5,60 @@
 /* borders with they collide. Mouse operations are used to  */
 /* "freeze" stars and keyboard and menu operations are used */
 /* to resize or recolor those stars that are frozen.        */
+/*                                                          */
+/* Usage: a.out [-record session.rec | -replay session.rec] */
+/*              [-profile frames.csv]                       */
+/*                                                          */
+/*   -record  save the seed and every input event to a     */
+/*            file when the window closes                   */
+/*   -replay  play a recorded session back step for step;   */
+/*            live input is ignored until it ends           */
+/*   -profile save per-phase times of the last 600 frames   */
+/*            and simulation rounds when the window closes  */
+/*            (frames.csv and frames-ticks.csv; 'f' shows   */
+/*            them)                                         */
+/*                                                          */
+/* '[' and ']' shorten and lengthen the particle trails.    */
+/*                                                          */
+/* The world is stepped on a thread of its own, which hands */
+/* a copy of what to draw to the GLUT thread after every    */
+/* tick. Drawing never waits for a step or a step for a     */
+/* frame, so a frame takes the longer of the two instead of */
+/* their sum.                                               */
 /************************************************************/
 
+#define GL_GLEXT_PROTOTYPES // Buffer objects, for Renderer.h
+
+#ifdef __APPLE__
 #include <GLUT/glut.h>
+#else
+#include <GL/glut.h>
+#endif
 #include <math.h>			// Header File For Math Library
 #include <time.h>			// Header File For Accessing System Time
 #include "LinkedList.h"		// Header File For Linked List Class
 #include <iostream>
 
 #include <fstream>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "Graphics.h"
 #include "Asteroid.h"
+#include "World.h"
+#include "Clock.h"
+#include "Timestep.h"
+#include "Renderer.h"
+#include "RenderState.h"
+#include "TripleBuffer.h"
+#include "Input.h"
+#include "Profiler.h"
 
 //////////////////////
 // Global Constants //
@@ -35,37 +77,48 @@ using namespace std;
 void key_press(unsigned char pressedKey, int mouseXPosition, int mouseYPosition);
 void mouse_click(int mouseButton, int mouseState, int mouseXPosition, int mouseYPosition);
 void menu(int menuID);
-void tick(int value);
+void idle();
 void draw();
 void resize_window(GLsizei w, GLsizei h);
+void set_projection(const RenderState &state);
+void simulate();
+void take_input();
+void publish(double now);
+void stop_simulation();
+void print_stats();
+void play_events(const InputEvent *events, int count);
+void save_recording();
+void save_profile();
+void draw_profile(const RenderState &state);
 void init_gl( void (*f)() );
 void init_main();
 
-void draw_particle_system( ParticleSystem *particles );
-void draw_asteroid( Asteroid *asteroid );
-bool asteroid_click( Asteroid *asteroid );
-void pause_asteroid( Asteroid *asteroid );
-void unpause_asteroid( Asteroid *asteroid );
-void pause_particles( ParticleSystem *particles );
-void unpause_particles( ParticleSystem *particles );
-void garbage_collect_asteroids( Asteroid *asteroid );
-void garbage_collect_particles( ParticleSystem *particles );
-
 
 //////////////////////
 // Global Variables //
 //////////////////////
-int   g_current_window_size[] = { 1000, 750 };  // Window size in pixels { w, h }
-float g_window_ratio[]        = { 4.0f, 3.0f }; // Window ratio { w, h }
-
-LinkedList<Asteroid*>       g_asteroids; // Linked list of pointers to all of the Asteroids
-LinkedList<ParticleSystem*> g_particles; // Linked list of pointers to all of the ParticleSystems
-
-Point<> g_click_coordinates; // Coordinates of the last click on the screen
-
-bool  g_is_paused;
-
-Random<> g_random;
+// Once the simulation thread starts, only it touches these
+World         g_world;    // All of the Asteroids and ParticleSystems
+FixedTimestep g_timestep; // Steps g_world every 50ms of real time
+Controls      g_controls( g_world ); // Turns input events into changes to g_world
+InputLog      g_input;    // Every input event, recorded or being replayed
+Profiler      g_sim_profiler; // Where the time of the last 600 rounds of steps went
+
+// Only the GLUT thread touches these
+Renderer      g_renderer; // Draws the latest RenderState in a few batched draw calls
+Profiler      g_profiler; // Where the time of the last 600 frames went
+int           g_window_size[2]; // In pixels { w, h }
+
+// Between the two
+TripleBuffer<RenderState> g_frames;     // The latest tick, handed from simulation to drawing
+InputQueue                g_queue;      // Live input, handed from the callbacks to the simulation
+std::thread               g_simulation; // Runs simulate()
+std::atomic<bool>         g_simulating( false );
+
+const char *g_record_path  = NULL; // Where to save the session on exit
+const char *g_profile_path = NULL; // Where to save frame times on exit
+bool        g_replay_done  = false;
+bool        g_show_profile = false; // Frame time overlay
 
 /* The main function: uses the OpenGL Utility Toolkit to set */
 /* the window up to display the window and its contents.     */
@@ -73,49 +126,62 @@ int main(int argc, char **argv)
 {
 	glutInit (&argc, argv);
 
-  init_gl( init_main );
+  g_input.start( time(0) );
 
-  // Collects the garbage for both of the linked lists
-  g_asteroids.each( garbage_collect_asteroids );
-  g_particles.each( garbage_collect_particles );
-}
-
-void init_main()
-{
-  // Collects the garbage for both of the linked lists
-  g_asteroids.each( garbage_collect_asteroids );
-  g_particles.each( garbage_collect_particles );
-
-  // Reinitialize the linked lists
-  g_asteroids = LinkedList<Asteroid*>();
-  g_particles = LinkedList<ParticleSystem*>();
+  for( int i = 1; i < argc; i += 2 )
+  {
+    if( i + 1 < argc && strcmp( argv[i], "-record" ) == 0 && g_input.length == 0 )
+    {
+      g_record_path = argv[i + 1];
+      atexit( save_recording );
+    }
+    else if( i + 1 < argc && strcmp( argv[i], "-replay" ) == 0 && g_record_path == NULL )
+    {
+      if( !g_input.load( argv[i + 1] ) )
+      {
+        cerr << "could not read a session from " << argv[i + 1] << endl;
+        return( 1 );
+      }
+    }
+    else if( i + 1 < argc && strcmp( argv[i], "-profile" ) == 0 )
+    {
+      g_profile_path = argv[i + 1];
+      atexit( save_profile );
+    }
+    else
+    {
+      cerr << "usage: " << argv[0] << " [-record session.rec | -replay session.rec] [-profile frames.csv]" << endl;
+      return( 1 );
+    }
+  }
 
-  g_is_paused = false;
+  g_world.profiler = &g_sim_profiler;
 
-  // Generate X number of asteroids, places them at random
-  // points on the screen, and inserts them into the list
-  Asteroid *asteroid;
-  Point<>     random_point;
-  for( int i = 0; i < 12; i++ )
-  {
-    random_point.x = g_random.next( -g_window_ratio[0]/2.0, g_window_ratio[0]/2.0 );
-    random_point.y = g_random.next( -g_window_ratio[1]/2.0, g_window_ratio[1]/2.0 );
+  // Thin explosions out when particles take more than 5ms a step.
+  // This depends on the machine, so not when the run has to repeat.
+  if( g_record_path == NULL && g_input.length == 0 )
+    g_world.budget.target_ms = 5;
 
-    asteroid = new Asteroid( Range<>( .1f, .2f ) );
-    asteroid->move_to( random_point );
+  init_gl( init_main );
+}
 
-    g_asteroids.insert( asteroid );
-  }
+void init_main()
+{
+  // Throw away the old world and generate 12 new asteroids
+  g_world.reset( g_controls.asteroids );
 }
 
 void init_gl( void (*f)() )
 {
-  srand(time(0));
+  g_world.seed( g_input.seed );
   
 	/* Set up the display window. */
   glutInitDisplayMode( GLUT_DOUBLE | GLUT_RGBA );
   glutInitWindowPosition( INIT_WINDOW_POSITION[0], INIT_WINDOW_POSITION[1] );
-  glutInitWindowSize( g_current_window_size[0], g_current_window_size[1] );
+  g_window_size[0] = g_controls.window_size[0];
+  g_window_size[1] = g_controls.window_size[1];
+
+  glutInitWindowSize( g_window_size[0], g_window_size[1] );
   glutCreateWindow( "Astroids!!!" );
 
   // AntiAliasing
@@ -133,13 +199,22 @@ void init_gl( void (*f)() )
   // Call program specific init code;
   f();
 
+  // Hand the first state over, then let the world run on its own.
+  // Registered last, so it stops before the other exit handlers read
+  // the world.
+  publish( now_in_seconds() );
+
+  g_simulating.store( true );
+  g_simulation = std::thread( simulate );
+  atexit( stop_simulation );
+
 
 	/* Specify the resizing, refreshing, and interactive routines. */
 	glutReshapeFunc( resize_window );
 	glutDisplayFunc( draw );
   glutKeyboardFunc( key_press );
 	glutMouseFunc( mouse_click );
-	glutTimerFunc(50, tick, 1);
+	glutIdleFunc( idle );
 	glutMainLoop();
 }
 
@@ -148,130 +223,107 @@ void init_gl( void (*f)() )
 /* boundaries and, if so, by freezing (or unfreezing) that star.    */
 void mouse_click(int mouse_button, int mouse_state, int mouse_x, int mouse_y)
 {
-  // Exit function if mouse is not done, or if the game is paused
+  // Exit function if mouse is not down
 	if( mouse_state != GLUT_DOWN ) return;
-  if( g_asteroids.getHeadValue()->is_paused ) return;
-
-  // Converts the coordinates passed in, into the windows coordinate system
-	g_click_coordinates.x = g_window_ratio[0] * mouse_x / g_current_window_size[0] - 0.5 * g_window_ratio[0];
-	g_click_coordinates.y = 0.5 * g_window_ratio[1] - (g_window_ratio[1] * mouse_y / g_current_window_size[1]);
 
-  // Call asteroid_click for each asteroid in the linked list
-  g_asteroids.each( asteroid_click );
+  // Explode the first asteroid under the click (ignored while paused),
+  // along with any other clicks, before the next step
+  g_queue.post( INPUT_CLICK, mouse_button, mouse_x, mouse_y );
 }
 
-bool asteroid_click( Asteroid* asteroid )
+// Draws the latest state the simulation handed over, without waiting
+// for the next
+void draw()
 {
-  // If not hit, move on to the next asteroid in the list
-  if( !asteroid->hit_test( g_click_coordinates ) )
-    return( true );
+  {
+    Profiler::Scope scope( &g_profiler, Profiler::DRAW );
 
+    const RenderState &state = g_frames.latest();
 
-  // Remove the asteroid clicked on from the linked list
-  g_asteroids.removeHead();
+    set_projection( state );
 
-  // If the asteroid clicked on can explode into smaller chunks,
-  // expode, and add the fragments to the list of asteroids on
-  // the screen;
-  if( asteroid->can_explode() )
-  {
-    Asteroid **fragments = asteroid->get_fragments();
+    glClear(GL_COLOR_BUFFER_BIT);
+    glLineWidth(2);
 
-    for( int i = 0, n = asteroid->fragment_count; i < n; i++ )
-      g_asteroids.insert( fragments[i] );
+    // Draws the world as far into the tick after the state as the frame
+    // falls, with particles trailing fading lines. If the next state is
+    // late, it holds at the end of this one.
+    float alpha = float( ( now_in_seconds() - state.time ) / g_timestep.dt );
 
-    garbage_collect_array( fragments );
+    g_renderer.draw( state, alpha < 0 ? 0 : alpha > 1 ? 1 : alpha );
+
+    if( g_show_profile )
+      draw_profile( state );
   }
 
-  // Get the asteroids particle system and add it to the global
-  // particle system linked list
-  g_particles.insert( asteroid->get_particle_system() );
+  {
+    Profiler::Scope scope( &g_profiler, Profiler::SWAP );
 
-  garbage_collect( asteroid );
+    glutSwapBuffers();
+    glFlush();
+  }
 
-  // End the loop
-  return( false );
+  g_profiler.end_frame();
 }
 
-void draw()
+/* Writes min/avg/p99 times per phase in the top left corner:  */
+/* the simulation's phases, drawing and swapping, then the     */
+/* totals of a round of steps ("tick") and of a frame, and how */
+/* deep the input queue is and how long input waits in it      */
+void draw_profile( const RenderState &state )
 {
-	glClear(GL_COLOR_BUFFER_BIT);
-	glLineWidth(2);
+  float pixel = state.ratio[0] / g_window_size[0]; // In field units
+  float left  = -0.5f * state.ratio[0] + 8 * pixel;
+  float top   =  0.5f * state.ratio[1];
+  char  line[80];
 
-  // Draws each asteroid and particle system in its linked list
-  g_asteroids.each( draw_asteroid, false );
-  g_particles.each( draw_particle_system );
+  glColor3f( 1, 1, 0 );
 
-  glutSwapBuffers();
-	glFlush();
-}
-
-void draw_particle_system( ParticleSystem *particles )
-{
-  // Draw particles with a 3 pixel blur until they fade out
-  // when they have faded out, delete them
-  if( !particles->draw( 3 ) )
+  for( int p = -1; p <= Profiler::PHASE_COUNT + 2; p++ )
   {
-    garbage_collect( particles ); 
-    g_particles.removeHead();
+    if( p < 0 )
+      snprintf( line, sizeof( line ), "%-10s %7s %7s %7s", "ms", "min", "avg", "p99" );
+    else if( p == Profiler::PHASE_COUNT + 2 )
+      snprintf( line, sizeof( line ), "input      %d deep (max %d), waits %.2f avg %.2f max", g_queue.depth(),
+                g_queue.max_depth(), g_queue.average_latency() * 1e3, g_queue.max_latency() * 1e3 );
+    else
+    {
+      // The simulation thread times everything before drawing
+      bool      is_sim   = p < Profiler::DRAW || p == Profiler::PHASE_COUNT;
+      Profiler &profiler = is_sim ? g_sim_profiler : g_profiler;
+
+      Profiler::Summary summary = profiler.summarize( p < Profiler::PHASE_COUNT ? p : int( Profiler::PHASE_COUNT ) );
+
+      snprintf( line, sizeof( line ), "%-10s %7.2f %7.2f %7.2f",
+                p < Profiler::PHASE_COUNT ? Profiler::phase_name( p ) : p == Profiler::PHASE_COUNT ? "tick" : "frame",
+                summary.min, summary.avg, summary.p99 );
+    }
+
+    glRasterPos2f( left, top - ( p + 2 ) * 15 * pixel );
+
+    for( const char *c = line; *c; c++ )
+      glutBitmapCharacter( GLUT_BITMAP_8_BY_13, *c );
   }
 }
 
-// This function draws an asteroid
-void draw_asteroid( Asteroid *asteroid )
-{
-  asteroid->draw();
-  asteroid->check_boundaries( g_window_ratio[1], g_window_ratio[0] );
-}
-
 /* Function to react to the pressing of keyboard keys by  */
 /* the user, by resetting or pausing the animated action. */
 void key_press(unsigned char key, int mouse_x, int mouse_y)
 {
-  switch( tolower( key ) )
-	{
-    case 'r': 
-      init_main();
-      break;
+  // 'r' resets and 'p' pauses, through g_controls so replays see them;
+  // 'i' prints the simulation's counters
+  g_queue.post( INPUT_KEY, key, mouse_x, mouse_y );
 
-		case 'p':
-      // If one is paused, tehy should all be paused, so unpause all of them
-      if( g_is_paused )//g_asteroids.getHeadValue()->is_paused )
-      {
-        g_asteroids.each( unpause_asteroid );
-        g_particles.each( unpause_particles );
-      }
-      else
-      {
-        g_asteroids.each( pause_asteroid );
-        g_particles.each( pause_particles );
-      }
-
-      g_is_paused = !g_is_paused;
-
-      break; 
-	}
-}
-
-// Functions to pause/unpause an asteroid or particle system
-void pause_asteroid( Asteroid *asteroid )
-{
-  asteroid->is_paused = true;
-}
+  if( tolower( key ) == 'f' )
+    g_show_profile = !g_show_profile;
 
-void unpause_asteroid( Asteroid *asteroid )
-{
-  asteroid->is_paused = false;
-}
+  // '[' and ']' shorten and lengthen particle trails. They only change
+  // the drawing; Controls ignores them.
+  if( key == '[' )
+    g_renderer.list.trail = g_renderer.list.trail > .25f ? g_renderer.list.trail - .25f : 0;
 
-void pause_particles( ParticleSystem *particles )
-{
-  particles->is_paused = true;
-}
-
-void unpause_particles( ParticleSystem *particles )
-{
-  particles->is_paused = false;
+  if( key == ']' )
+    g_renderer.list.trail += .25f;
 }
 
 /* Function to react to selection from the pop-up    */
@@ -293,47 +345,168 @@ void menu( int selection )
 	//glutPostRedisplay();
 }
 
-void tick( int value )
+// Runs whenever GLUT is idle: draws again. Drawing is only held back
+// by vsync.
+void idle()
 {
 	glutPostRedisplay();
-	glutTimerFunc(50, tick, 1);
 }
 
-/* Window-reshaping routine, to scale the rendered scene according */
-/* to the window dimensions, setting the global variables so the   */
-/* mouse operations will correspond to mouse pointer positions.    */
-void resize_window( GLsizei w, GLsizei h )
+// The simulation thread: steps the world for however much time has
+// passed, taking the input that came in before each step, and hands
+// over the new state, then sleeps until the next step is due. It
+// never waits for a frame to be drawn.
+void simulate()
 {
-	glViewport(0, 0, w, h);
-	g_current_window_size[0] = w;
-	g_current_window_size[1] = h;
-  
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
-  if (w <= h)
-	{
-		g_window_ratio[0] = 2.0;
-		g_window_ratio[1] = 2.0 * (GLfloat)h / (GLfloat)w;
-    
-    glOrtho(-1.0, 1.0, -1.0 * (GLfloat)h / (GLfloat)w, (GLfloat)h / (GLfloat)w, -10.0, 10.0);
-	}
+  while( g_simulating.load() )
+  {
+    double now = now_in_seconds();
+
+    int steps = g_timestep.advance( now, []()
+    {
+      g_input.play( play_events );
+      take_input();
+      g_world.update();
+      g_input.step();
+    } );
+
+    if( g_input.length > 0 && !g_input.is_playing() && !g_replay_done )
+    {
+      // Events that came in after the last step of the recording
+      g_input.play( play_events );
+      g_replay_done = true;
+
+      cout << "replay finished after " << g_input.tick << " steps, checksum "
+           << hex << g_world.checksum() << dec << endl;
+    }
+
+    if( steps > 0 )
+    {
+      publish( now );
+      g_sim_profiler.end_frame();
+    }
+
+    std::this_thread::sleep_for( std::chrono::duration<double>( ( 1 - g_timestep.alpha() ) * g_timestep.dt ) );
+  }
+}
+
+// Drains the live input that came in since the last step, records it
+// and applies it as one batch, the way a replay will. While a session
+// replays, it is ignored.
+void take_input()
+{
+  Profiler::Scope scope( &g_sim_profiler, Profiler::INPUT );
+
+  size_t first = g_input.events.size();
+
+  g_queue.drain( []( const InputEvent &event )
+  {
+    if( event.type == INPUT_KEY && tolower( event.code ) == 'i' )
+      print_stats();
+
+    if( !g_input.is_playing() )
+      g_input.record( InputType( event.type ), event.code, event.x, event.y );
+  } );
+
+  if( g_input.events.size() > first )
+    g_controls.apply_all( &g_input.events[ first ], int( g_input.events.size() - first ) );
+}
+
+// Copies the world out for the GLUT thread. "now" is when the last
+// advance() ran; the state's tick began alpha steps before it.
+void publish( double now )
+{
+  // Capturing is the simulation's share of drawing
+  Profiler::Scope scope( &g_sim_profiler, Profiler::DRAW );
+
+  RenderState &state = g_frames.back();
+
+  state.capture( g_world );
+  state.time = now - g_timestep.alpha() * g_timestep.dt;
+
+  g_frames.publish();
+}
+
+void stop_simulation()
+{
+  g_simulating.store( false );
+
+  if( g_simulation.joinable() )
+    g_simulation.join();
+}
+
+void print_stats()
+{
+  cout << g_timestep.frames << " rounds, " << g_timestep.steps << " steps, "
+       << g_timestep.caught_up << " caught up, " << g_timestep.dropped << " dropped, "
+       << g_frames.skipped << " of " << g_frames.published << " states never drawn, "
+       << "checksum " << hex << g_world.checksum() << dec << endl
+       << g_world.budget.live << " particles (peak " << g_world.budget.peak << ", cap " << g_world.budget.max_particles
+       << "), density " << g_world.budget.density << ", " << g_world.budget.spawned << " systems ("
+       << g_world.budget.shrunk << " shrunk), " << g_world.budget.retired << " retired early" << endl
+       << g_queue.events() << " input events in " << g_queue.batches() << " batches, "
+       << g_queue.depth() << " waiting (deepest " << g_queue.max_depth() << "), " << g_queue.dropped() << " dropped, "
+       << "latency " << g_queue.average_latency() * 1e3 << " ms avg, " << g_queue.max_latency() * 1e3 << " ms max" << endl;
+}
+
+// Applies a batch of replayed events
+void play_events( const InputEvent *events, int count )
+{
+  Profiler::Scope scope( &g_sim_profiler, Profiler::INPUT );
+
+  g_controls.apply_all( events, count );
+}
+
+void save_recording()
+{
+  if( g_input.save( g_record_path ) )
+    cout << "recorded " << g_input.events.size() << " events over " << g_input.tick << " steps to "
+         << g_record_path << ", checksum " << hex << g_world.checksum() << dec << endl;
   else
-	{
-		g_window_ratio[0] = 2.0 * (GLfloat)w / (GLfloat)h;
-		g_window_ratio[1] = 2.0;
-    
-    glOrtho(-1.0 * (GLfloat)w / (GLfloat)h, (GLfloat)w / (GLfloat)h, -1.0, 1.0, -10.0, 10.0);
-	}
-  
-  glMatrixMode(GL_MODELVIEW);
+    cerr << "could not write " << g_record_path << endl;
+}
+
+// Frames to the given path, rounds of steps next to it: frames.csv
+// and frames-ticks.csv
+void save_profile()
+{
+  string ticks_path( g_profile_path );
+  size_t dot = ticks_path.rfind( '.' );
+
+  ticks_path.insert( dot == string::npos || ticks_path.find( '/', dot ) != string::npos ? ticks_path.size() : dot, "-ticks" );
+
+  if( g_profiler.write_csv( g_profile_path ) )
+    cout << "saved " << g_profiler.stored() << " frame times to " << g_profile_path << endl;
+  else
+    cerr << "could not write " << g_profile_path << endl;
+
+  if( g_sim_profiler.write_csv( ticks_path.c_str() ) )
+    cout << "saved " << g_sim_profiler.stored() << " tick times to " << ticks_path << endl;
+  else
+    cerr << "could not write " << ticks_path << endl;
 }
 
-void garbage_collect_asteroids( Asteroid *asteroid )
+/* Window-reshaping routine, to scale the rendered scene according  */
+/* to the window dimensions, telling the simulation the new size so */
+/* the mouse operations will correspond to mouse pointer positions. */
+/* While replaying, the field keeps the recorded size and is just   */
+/* stretched over whatever window there is.                         */
+void resize_window( GLsizei w, GLsizei h )
 {
-  garbage_collect( asteroid );
+	glViewport(0, 0, w, h);
+
+  g_window_size[0] = w;
+  g_window_size[1] = h;
+
+  g_queue.post( INPUT_RESIZE, 0, w, h );
 }
 
-void garbage_collect_particles( ParticleSystem *particles )
+// Shows the whole field of a state, centred on the origin. Set every
+// frame, since the field changes size on the simulation thread.
+void set_projection( const RenderState &state )
 {
-  garbage_collect( particles );
-}
\ No newline at end of file
+  glMatrixMode(GL_PROJECTION);
+  glLoadIdentity();
+  glOrtho(-0.5 * state.ratio[0], 0.5 * state.ratio[0], -0.5 * state.ratio[1], 0.5 * state.ratio[1], -10.0, 10.0);
+  glMatrixMode(GL_MODELVIEW);
+}
@@ -1,38 +1,128 @@
 #ifndef RANDOM_H
 #define RANDOM_H
 
-#include <cstdlib>
+#include <stdint.h>
 
 #include "Range.h"
+#include "Fixed.h"
 
 namespace Graphics
 {
+  // Every default constructed Random<> takes its seed from this
+  // sequence, so seeding it once makes the whole program repeatable.
+  inline uint64_t &random_seed_sequence()
+  {
+    static uint64_t sequence = 0x853c49e6748fea9bULL;
+    return( sequence );
+  }
+
+  inline void seed_random( uint64_t seed )
+  {
+    random_seed_sequence() = seed;
+  }
+
+  // splitmix64, used to turn consecutive seeds into unrelated states
+  inline uint64_t mix_seed( uint64_t z )
+  {
+    z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+
+    return( z ^ ( z >> 31 ) );
+  }
+
+  // Uniform in [0, 1) from 32 random bits: the top 24 for a float,
+  // the top 16 (all the fraction there is) for a Fixed
+  template< typename T >
+  inline T unit_from_bits( uint32_t bits )
+  {
+    return( T( bits >> 8 ) * T( 1.0 / 16777216.0 ) );
+  }
+
+  template<>
+  inline Fixed unit_from_bits<Fixed>( uint32_t bits )
+  {
+    return( Fixed::from_raw( int32_t( bits >> 16 ) ) );
+  }
+
+  /* A random number generator with its own state (PCG32, 8 bytes),  */
+  /* so instances are independent of each other and of libc rand().  */
   template< typename T = float >
   class Random
   {
   public:
-    Random(){}
+    uint64_t state;
+
+    Random()
+    {
+      random_seed_sequence() += 0x9e3779b97f4a7c15ULL;
+      this->seed( mix_seed( random_seed_sequence() ) );
+    }
+
+    Random( uint64_t seed )
+    {
+      this->seed( seed );
+    }
+
+    void seed( uint64_t seed )
+    {
+      this->state = 0;
+      this->bits();
+      this->state += seed;
+      this->bits();
+    }
+
+    // 32 uniformly distributed random bits
+    uint32_t bits()
+    {
+      uint64_t old = this->state;
+      this->state  = old * 6364136223846793005ULL + 1442695040888963407ULL;
+
+      uint32_t xorshifted = uint32_t( ( ( old >> 18 ) ^ old ) >> 27 );
+      uint32_t rotation   = uint32_t( old >> 59 );
+
+      return( ( xorshifted >> rotation ) | ( xorshifted << ( ( -rotation ) & 31 ) ) );
+    }
+
+    // Uniform in [0, 1)
+    T unit()
+    {
+      return( unit_from_bits<T>( this->bits() ) );
+    }
 
     T next()
     {
-      return( rand() );
+      return( T( this->bits() >> 1 ) );
     }
 
     T next( T max )
     {
-      return( max * (T(rand()) / RAND_MAX) );
+      return( max * this->unit() );
     }
 
     T next( T min, T max )
     {
-      return( min + ((max - min) * (T(rand()) / RAND_MAX)) );
+      return( min + ((max - min) * this->unit()) );
     }
 
     T next( Range<T> r )
     {
-      return( r.min + ((r.max - r.min) * (T(rand()) / RAND_MAX)) );
+      return( r.min + ((r.max - r.min) * this->unit()) );
+    }
+
+    // Fills out[0..n) with values from the range, for batch consumers
+    void fill( T *out, int n, Range<T> r )
+    {
+      T span = r.max - r.min;
+
+      for( int i = 0; i < n; i++ )
+        out[i] = r.min + span * this->unit();
+    }
+
+    void fill( T *out, int n, T min, T max )
+    {
+      this->fill( out, n, Range<T>( min, max ) );
     }
   };
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,184 @@
+#ifndef RENDER_STATE_H
+#define RENDER_STATE_H
+
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
+#include "Graphics.h"
+#include "Asteroid.h"
+#include "World.h"
+#include "ShapeLibrary.h"
+
+namespace Graphics
+{
+  /* Everything drawing needs from one tick of a World, copied out so */
+  /* it can be drawn on another thread while the world moves on:      */
+  /* each asteroid's pose before and after the tick and its shape id, */
+  /* each particle system's color and its particles' positions and    */
+  /* velocities (trails and the lag are drawn along them).            */
+  /*                                                                  */
+  /* Shape ids index a copy of the ShapeLibrary's tables, taken again */
+  /* only when the library has changed, so a state never points into  */
+  /* anything the simulation may reallocate. Once captured it is      */
+  /* only read, and a DrawList builds from it exactly as from the     */
+  /* World it came from.                                              */
+  class RenderState
+  {
+  public:
+    // An asteroid at the start and end of the tick, in floats
+    struct Pose
+    {
+      float2 from, to;
+      float  from_rotation, to_rotation; // Degrees
+      int    shape;
+      int    sides;
+    };
+
+    // A particle system's slice of the particle arrays
+    struct Burst
+    {
+      int           first, count;
+      unsigned char rgba[4];
+      bool          is_paused;
+    };
+
+    std::vector<Pose>  asteroids;
+    std::vector<Burst> bursts;
+
+    std::vector<float> x, y;   // Every particle's position
+    std::vector<float> vx, vy; // and velocity
+
+    float         ratio[2]; // Size of the playing field { w, h }
+    unsigned long ticks;    // World::ticks when captured
+    double        time;     // Wall clock time the tick began, for callers that interpolate by time
+
+    RenderState()
+    {
+      this->ratio[0] = 4.0f;
+      this->ratio[1] = 3.0f;
+
+      this->ticks = 0;
+      this->time  = 0;
+
+      this->shape_revision = 0;
+    }
+
+    // Copies out the world as it stands after its last update()
+    void capture( World &world )
+    {
+      this->ratio[0] = world.ratio[0];
+      this->ratio[1] = world.ratio[1];
+      this->ticks    = world.ticks;
+
+      this->capture_shapes();
+      this->capture_asteroids( world );
+      this->capture_particles( world );
+    }
+
+    // Vertices of a shape, relative to its centre
+    const float2 *points( int shape ) const
+    {
+      return( &this->shape_vertices[ this->shape_offsets[ shape ] ] );
+    }
+
+    int particle_count() const
+    {
+      return( int( this->x.size() ) );
+    }
+
+  private:
+    std::vector<float2> shape_vertices;
+    std::vector<int>    shape_offsets;
+    unsigned long       shape_revision; // ShapeLibrary::revision copied, or 0
+
+    void capture_shapes()
+    {
+      ShapeLibrary &library = ShapeLibrary::shared();
+      if( this->shape_revision == library.revision ) return;
+
+      const std::vector< Point<> >             &vertices = library.all_vertices();
+      const std::vector< ShapeLibrary::Shape > &shapes   = library.all_shapes();
+
+      this->shape_vertices.assign( vertices.begin(), vertices.end() );
+
+      this->shape_offsets.resize( shapes.size() );
+      for( size_t i = 0; i < shapes.size(); i++ )
+        this->shape_offsets[i] = shapes[i].offset;
+
+      this->shape_revision = library.revision;
+    }
+
+    void capture_asteroids( World &world )
+    {
+      this->asteroids.resize( world.asteroids.size() );
+
+      for( int a = 0, n = world.asteroids.size(); a < n; a++ )
+      {
+        Asteroid &asteroid = world.asteroids[a];
+        Pose     &pose     = this->asteroids[a];
+
+        pose.from          = to_float( asteroid.previous_location );
+        pose.to            = to_float( asteroid.location );
+        pose.from_rotation = to_float( asteroid.previous_rotation );
+        pose.to_rotation   = to_float( asteroid.rotation );
+        pose.shape         = asteroid.shape;
+        pose.sides         = asteroid.sides;
+      }
+    }
+
+    // Systems that already released their particles are left out
+    void capture_particles( World &world )
+    {
+      this->bursts.clear();
+
+      size_t total = 0;
+
+      for( int s = 0, n = world.particles.size(); s < n; s++ )
+      {
+        ParticleSystem &particles = world.particles[s];
+        if( particles.is_clean ) continue;
+
+        particles.set_opacity();
+
+        Burst burst;
+        burst.first     = int( total );
+        burst.count     = particles.count;
+        burst.rgba[0]   = to_byte( particles.color[0] );
+        burst.rgba[1]   = to_byte( particles.color[1] );
+        burst.rgba[2]   = to_byte( particles.color[2] );
+        burst.rgba[3]   = to_byte( particles.opacity );
+        burst.is_paused = particles.is_paused;
+
+        this->bursts.push_back( burst );
+        total += particles.count;
+      }
+
+      this->x.resize( total );
+      this->y.resize( total );
+      this->vx.resize( total );
+      this->vy.resize( total );
+
+      for( int s = 0, b = 0, n = world.particles.size(); s < n; s++ )
+      {
+        ParticleSystem &particles = world.particles[s];
+        if( particles.is_clean ) continue;
+
+        size_t first = this->bursts[ b++ ].first;
+        size_t bytes = particles.count * sizeof( float );
+
+        memcpy( this->x.data() + first,  particles.x,  bytes );
+        memcpy( this->y.data() + first,  particles.y,  bytes );
+        memcpy( this->vx.data() + first, particles.vx, bytes );
+        memcpy( this->vy.data() + first, particles.vy, bytes );
+      }
+    }
+
+    static unsigned char to_byte( float f )
+    {
+      return( (unsigned char)( f <= 0 ? 0 : f >= 1 ? 255 : f * 255 + .5f ) );
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "World.h"
+#include "RenderState.h"
+#include "DrawList.h"
+
+namespace Graphics
+{
+  /* Draws a whole World in four draw calls: every asteroid fill as  */
+  /* one batch of triangles, every outline as one batch of lines,     */
+  /* every particle trail as one batch of fading lines and every      */
+  /* particle as one batch of points.                                 */
+  /*                                                                  */
+  /* The batches come from a DrawList, transformed on the CPU, and    */
+  /* are streamed into vertex buffer objects. Only GL 1.5 buffer      */
+  /* objects and fixed function client arrays are used, so it runs on */
+  /* any driver, Mesa's llvmpipe included. Needs a current GL         */
+  /* context; the buffers are created on the first draw.              */
+  class Renderer
+  {
+  public:
+    DrawList list;        // Staging for the batches; list.trail sets the trail length
+    float    trail_width; // Of trail lines, in pixels
+    int      draw_calls;  // Issued by the last draw()
+
+    Renderer()
+    {
+      this->trail_width = 1;
+      this->draw_calls  = 0;
+      this->has_buffers = false;
+    }
+
+    // Draws the world "alpha" of the way between its last two states
+    void draw( World &world, float alpha )
+    {
+      this->list.build( world, alpha );
+      this->submit();
+    }
+
+    // Draws a captured state "alpha" of the way through its tick. This
+    // touches nothing but the state, so it can run while the world that
+    // captured it is being stepped on another thread.
+    void draw( const RenderState &state, float alpha )
+    {
+      this->list.build( state, alpha );
+      this->submit();
+    }
+
+  private:
+    enum Buffer { FILLS, LINES, POINTS, COLORS, TRAILS, TRAIL_COLORS, BUFFER_COUNT };
+
+    GLuint buffers[ BUFFER_COUNT ];
+    bool   has_buffers;
+
+    Renderer( const Renderer & );
+    Renderer &operator=( const Renderer & );
+
+    // Draws whatever the list holds
+    void submit()
+    {
+      if( !this->has_buffers )
+      {
+        glGenBuffers( BUFFER_COUNT, this->buffers );
+        this->has_buffers = true;
+      }
+
+      this->draw_calls = 0;
+
+      glEnableClientState( GL_VERTEX_ARRAY );
+
+      // Fills first, so outlines are never covered by a neighbour's fill
+      glColor3f( 0, 0, 0 );
+      this->draw_array( GL_TRIANGLES, FILLS, this->list.fills );
+
+      glColor3f( 1, 1, 1 );
+      this->draw_array( GL_LINES, LINES, this->list.lines );
+
+      // Trails are thinner than outlines; the caller's width is put back
+      glPushAttrib( GL_LINE_BIT );
+      glLineWidth( this->trail_width );
+      this->draw_colored( GL_LINES, TRAILS, TRAIL_COLORS, this->list.trails, this->list.trail_colors );
+      glPopAttrib();
+
+      this->draw_colored( GL_POINTS, POINTS, COLORS, this->list.points, this->list.colors );
+
+      glDisableClientState( GL_VERTEX_ARRAY );
+      glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    }
+
+    // Streams "bytes" of data into one of the buffers, leaving it bound
+    void upload( Buffer buffer, size_t bytes, const void *data )
+    {
+      glBindBuffer( GL_ARRAY_BUFFER, this->buffers[ buffer ] );
+      glBufferData( GL_ARRAY_BUFFER, bytes, data, GL_STREAM_DRAW );
+    }
+
+    void draw_array( GLenum mode, Buffer buffer, std::vector<float2> &vertices )
+    {
+      if( vertices.empty() ) return;
+
+      this->upload( buffer, vertices.size() * sizeof( float2 ), &vertices[0] );
+      glVertexPointer( 2, GL_FLOAT, 0, NULL );
+      glDrawArrays( mode, 0, GLsizei( vertices.size() ) );
+
+      this->draw_calls++;
+    }
+
+    // Draws vertices with an RGBA byte color each
+    void draw_colored( GLenum mode, Buffer buffer, Buffer color_buffer, std::vector<float2> &vertices,
+                       std::vector<unsigned char> &colors )
+    {
+      if( vertices.empty() ) return;
+
+      this->upload( color_buffer, colors.size(), &colors[0] );
+      glColorPointer( 4, GL_UNSIGNED_BYTE, 0, NULL );
+      glEnableClientState( GL_COLOR_ARRAY );
+
+      this->draw_array( mode, buffer, vertices );
+
+      glDisableClientState( GL_COLOR_ARRAY );
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef SHAPE_LIBRARY_H
+#define SHAPE_LIBRARY_H
+
+#include <vector>
+
+#include "Graphics.h"
+#include "Spokes.h"
+
+namespace Graphics
+{
+  /* Every asteroid outline the game uses, generated up front and     */
+  /* shared. An outline is just a random radius on each of a fixed    */
+  /* set of spokes, so a few thousand of them per size class look as  */
+  /* varied as generating a fresh one for every asteroid, and an      */
+  /* asteroid only has to remember which one it got (an index).       */
+  /*                                                                  */
+  /* A size class is a number of sides plus a range of radii. The     */
+  /* first asteroid of a class generates all of that class's shapes;  */
+  /* later ones just pick one. All vertices live in one array, so     */
+  /* they can also be uploaded somewhere in one go.                   */
+  class ShapeLibrary
+  {
+  public:
+    // Side counts an outline may have. Collision and drawing copy
+    // outlines into stack arrays of MAX_SIDES points.
+    static const int MIN_SIDES = 3;
+    static const int MAX_SIDES = 64;
+
+    int shapes_per_class;
+
+    unsigned long revision; // Changes whenever the tables do, for copies of them
+
+    ShapeLibrary( int shapes_per_class = 2048 )
+    {
+      this->shapes_per_class = shapes_per_class;
+      this->revision         = 1;
+    }
+
+    // Index of a random shape of the given class. Side counts outside
+    // [MIN_SIDES, MAX_SIDES] are clamped into it, so callers should
+    // take the count from sides() of the shape they get.
+    template< typename T >
+    int pick( int sides, Range<> radius, Random<T> &r )
+    {
+      if( sides < MIN_SIDES ) sides = MIN_SIDES;
+      if( sides > MAX_SIDES ) sides = MAX_SIDES;
+
+      SizeClass &size = this->find( sides, radius );
+
+      return( size.first + int( r.bits() % uint32_t( size.count ) ) );
+    }
+
+    // Vertices of a shape, relative to its centre. The pointer is only
+    // good until the next new size class is generated.
+    const Point<> *points( int shape ) const
+    {
+      return( &this->vertices[ this->shapes[ shape ].offset ] );
+    }
+
+    int sides( int shape ) const
+    {
+      return( this->shapes[ shape ].sides );
+    }
+
+    // Longest spoke of the shape
+    float outer_radius( int shape ) const
+    {
+      return( this->shapes[ shape ].outer_radius );
+    }
+
+    int shape_count() const
+    {
+      return( int( this->shapes.size() ) );
+    }
+
+    int class_count() const
+    {
+      return( int( this->classes.size() ) );
+    }
+
+    // Bytes of shape data held
+    size_t memory_used() const
+    {
+      return( this->vertices.capacity() * sizeof( Point<> ) + this->shapes.capacity() * sizeof( Shape ) +
+              this->classes.capacity() * sizeof( SizeClass ) );
+    }
+
+    // Never destroyed, like the pools, so asteroids can still be
+    // around while globals are torn down
+    static ShapeLibrary &shared()
+    {
+      static ShapeLibrary *library = new ShapeLibrary();
+      return( *library );
+    }
+
+    struct Shape
+    {
+      int   offset; // Of the first vertex
+      int   sides;
+      float outer_radius;
+    };
+
+    struct SizeClass
+    {
+      int     sides;
+      Range<> radius;
+      int     first; // Index of the first shape
+      int     count;
+    };
+
+    // The raw tables and generator, for saving the library whole
+    const std::vector< Point<> >   &all_vertices() const { return( this->vertices ); }
+    const std::vector< Shape >     &all_shapes()   const { return( this->shapes ); }
+    const std::vector< SizeClass > &all_classes()  const { return( this->classes ); }
+    uint64_t random_state() const { return( this->r.state ); }
+
+    // Replaces the whole library with saved tables. Shape indices held
+    // by existing asteroids then refer to the saved shapes.
+    void restore( const Point<> *vertices, int vertex_count, const Shape *shapes, int shape_count,
+                  const SizeClass *classes, int class_count, uint64_t random_state )
+    {
+      this->vertices.assign( vertices, vertices + vertex_count );
+      this->shapes.assign( shapes, shapes + shape_count );
+      this->classes.assign( classes, classes + class_count );
+
+      this->r.state = random_state;
+      this->revision++;
+    }
+
+  private:
+    std::vector< Point<> >   vertices;
+    std::vector< Shape >     shapes;
+    std::vector< SizeClass > classes;
+
+    Random<Real> r;
+
+    SizeClass &find( int sides, Range<> radius )
+    {
+      for( size_t i = 0; i < this->classes.size(); i++ )
+      {
+        SizeClass &size = this->classes[i];
+
+        if( size.sides == sides && size.radius.min == radius.min && size.radius.max == radius.max )
+          return( size );
+      }
+
+      return( this->generate( sides, radius ) );
+    }
+
+    SizeClass &generate( int sides, Range<> radius )
+    {
+      SizeClass size;
+      size.sides  = sides;
+      size.radius = radius;
+      size.first  = int( this->shapes.size() );
+      size.count  = this->shapes_per_class;
+
+      this->vertices.reserve( this->vertices.size() + size.count * sides );
+      this->shapes.reserve( this->shapes.size() + size.count );
+
+      for( int s = 0; s < size.count; s++ )
+      {
+        Shape shape;
+        shape.offset       = int( this->vertices.size() );
+        shape.sides        = sides;
+        shape.outer_radius = 0;
+
+        for( int i = 0; i < sides; i++ )
+        {
+          float length = to_float( this->r.next( Range<Real>( Real( radius.min ), Real( radius.max ) ) ) );
+
+          this->vertices.push_back( spoke( i, sides ) * length );
+
+          if( length > shape.outer_radius )
+            shape.outer_radius = length;
+        }
+
+        this->shapes.push_back( shape );
+      }
+
+      this->classes.push_back( size );
+      this->revision++;
+
+      return( this->classes.back() );
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,391 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <type_traits>
+#include <vector>
+
+#include "Graphics.h"
+#include "Asteroid.h"
+#include "ShapeLibrary.h"
+#include "Collision.h"
+#include "World.h"
+
+namespace Graphics
+{
+  /* A whole World saved as one flat file, so a benchmark can start   */
+  /* from a heavy late-game scene without playing up to it. After a   */
+  /* header come, each on a 64 byte boundary:                         */
+  /*                                                                  */
+  /*   the shape library's size classes, shapes and vertices          */
+  /*   every asteroid, exactly as it sits in memory                   */
+  /*   one fixed-size record per particle system                      */
+  /*   the particle arrays of every system, back to back              */
+  /*                                                                  */
+  /* save() writes the sections front to back with writev, straight   */
+  /* from where they live. load() maps the file and copies each       */
+  /* section into place; the asteroids go in with one memcpy and      */
+  /* nothing is parsed. The catch is that only a build with the same  */
+  /* struct layouts (and physics number type, float or fixed point)   */
+  /* can read a file, which the header checks. The                    */
+  /* shape library is replaced by the saved one, and the World goes   */
+  /* on exactly as the saved one would have (same random numbers).    */
+  namespace Snapshot
+  {
+    static_assert( std::is_trivially_copyable<Asteroid>::value, "asteroids are saved as raw bytes" );
+
+    const uint32_t VERSION = 4;
+    const size_t   ALIGN   = 64;
+
+    struct Header
+    {
+      char     magic[4];
+      uint32_t version;
+
+      // Layout checks
+      uint32_t asteroid_size;
+      uint32_t particle_size;
+      uint32_t shape_size;
+      uint32_t class_size;
+      uint32_t real_is_fixed;  // Asteroids of a -DFIXED_POINT build
+
+      uint32_t class_count;
+      uint32_t shape_count;
+      uint32_t vertex_count;
+      uint32_t asteroid_count;
+      uint32_t particle_count; // Systems
+      uint32_t shapes_per_class;
+      uint64_t float_count;    // Particle floats, all systems together
+      uint64_t file_size;
+
+      // World state
+      float    ratio[2];
+      uint32_t is_paused;
+      float    particle_density;
+      uint64_t ticks;
+      uint64_t explosions;
+      uint64_t world_random;
+      uint64_t library_random;
+      uint64_t seed_sequence;
+    };
+
+    // Everything about a ParticleSystem but its particles
+    struct ParticleRecord
+    {
+      Point<>  location;
+      int32_t  count;
+      uint32_t lanes[ ParticleKernels::LANES ];
+      uint64_t random;
+      Range<>  velocity_range;
+      int32_t  display_count;
+      int32_t  display_max;
+      float    chaos;
+      float    color[3];
+      float    opacity;
+      uint8_t  is_clean;
+      uint8_t  is_paused;
+    };
+
+    enum Section { CLASSES, SHAPES, VERTICES, ASTEROIDS, PARTICLES, FLOATS, SECTION_COUNT };
+
+    inline size_t aligned( size_t n )
+    {
+      return( ( n + ALIGN - 1 ) & ~( ALIGN - 1 ) );
+    }
+
+    // Where each section starts and how long it is; returns the size
+    // of the whole file
+    inline uint64_t layout( const Header &h, uint64_t offsets[ SECTION_COUNT ], uint64_t sizes[ SECTION_COUNT ] )
+    {
+      sizes[ CLASSES ]   = uint64_t( h.class_count ) * h.class_size;
+      sizes[ SHAPES ]    = uint64_t( h.shape_count ) * h.shape_size;
+      sizes[ VERTICES ]  = uint64_t( h.vertex_count ) * sizeof( Point<> );
+      sizes[ ASTEROIDS ] = uint64_t( h.asteroid_count ) * h.asteroid_size;
+      sizes[ PARTICLES ] = uint64_t( h.particle_count ) * h.particle_size;
+      sizes[ FLOATS ]    = h.float_count * sizeof( float );
+
+      uint64_t offset = aligned( sizeof( Header ) );
+      for( int s = 0; s < SECTION_COUNT; s++ )
+      {
+        offsets[s] = offset;
+        offset     = aligned( offset + sizes[s] );
+      }
+
+      return( offset );
+    }
+
+    // Writes every iovec in order, IOV_MAX at a time, picking up after
+    // short writes
+    inline bool write_all( int fd, std::vector<iovec> &pieces )
+    {
+      size_t next = 0;
+
+      while( next < pieces.size() )
+      {
+        int     n       = int( pieces.size() - next < IOV_MAX ? pieces.size() - next : IOV_MAX );
+        ssize_t written = writev( fd, &pieces[ next ], n );
+
+        if( written < 0 ) return( false );
+
+        while( next < pieces.size() && size_t( written ) >= pieces[ next ].iov_len )
+          written -= pieces[ next++ ].iov_len;
+
+        if( next < pieces.size() )
+        {
+          pieces[ next ].iov_base  = (char*)pieces[ next ].iov_base + written;
+          pieces[ next ].iov_len  -= written;
+        }
+      }
+
+      return( true );
+    }
+
+    inline bool save( World &world, const char *path )
+    {
+      static const char padding[ ALIGN ] = { 0 };
+
+      ShapeLibrary &library = ShapeLibrary::shared();
+
+      Header h;
+      memset( &h, 0, sizeof( h ) );
+      memcpy( h.magic, "ASTS", 4 );
+
+      h.version        = VERSION;
+      h.asteroid_size  = sizeof( Asteroid );
+      h.particle_size  = sizeof( ParticleRecord );
+      h.shape_size     = sizeof( ShapeLibrary::Shape );
+      h.class_size     = sizeof( ShapeLibrary::SizeClass );
+      h.real_is_fixed  = std::is_same< Real, Fixed >::value;
+
+      h.class_count      = uint32_t( library.all_classes().size() );
+      h.shape_count      = uint32_t( library.all_shapes().size() );
+      h.vertex_count     = uint32_t( library.all_vertices().size() );
+      h.asteroid_count   = uint32_t( world.asteroids.size() );
+      h.particle_count   = uint32_t( world.particles.size() );
+      h.shapes_per_class = uint32_t( library.shapes_per_class );
+
+      h.ratio[0]          = world.ratio[0];
+      h.ratio[1]          = world.ratio[1];
+      h.is_paused         = world.is_paused;
+      h.particle_density  = world.budget.density;
+      h.ticks             = world.ticks;
+      h.explosions        = world.explosions;
+      h.world_random      = world.random.state;
+      h.library_random    = library.random_state();
+      h.seed_sequence     = random_seed_sequence();
+
+      std::vector<ParticleRecord> records( h.particle_count );
+
+      for( uint32_t i = 0; i < h.particle_count; i++ )
+      {
+        ParticleSystem &p = world.particles[i];
+        ParticleRecord &record = records[i];
+
+        memset( (void*)&record, 0, sizeof( record ) );
+        record.location       = p.location;
+        record.count          = p.count;
+        memcpy( record.lanes, p.lanes, sizeof( record.lanes ) );
+        record.random         = p.r.state;
+        record.velocity_range = p.velocity_range;
+        record.display_count  = p.display_count;
+        record.display_max    = p.display_max;
+        record.chaos          = p.chaos;
+        memcpy( record.color, p.color, sizeof( record.color ) );
+        record.opacity        = p.opacity;
+        record.is_clean       = p.is_clean;
+        record.is_paused      = p.is_paused;
+
+        if( !p.is_clean )
+          h.float_count += 4 * uint64_t( p.count );
+      }
+
+      uint64_t offsets[ SECTION_COUNT ], sizes[ SECTION_COUNT ];
+      h.file_size = layout( h, offsets, sizes );
+
+      // Gather every piece in file order, padding included
+      std::vector<iovec> pieces;
+      uint64_t           at = 0;
+
+      auto add = [&]( const void *data, uint64_t bytes )
+      {
+        if( bytes == 0 ) return;
+
+        iovec piece;
+        piece.iov_base = (void*)data;
+        piece.iov_len  = size_t( bytes );
+
+        pieces.push_back( piece );
+        at += bytes;
+      };
+
+      auto pad_to = [&]( uint64_t offset )
+      {
+        add( padding, offset - at );
+      };
+
+      add( &h, sizeof( h ) );
+
+      pad_to( offsets[ CLASSES ] );
+      if( h.class_count )    add( &library.all_classes()[0],  sizes[ CLASSES ] );
+      pad_to( offsets[ SHAPES ] );
+      if( h.shape_count )    add( &library.all_shapes()[0],   sizes[ SHAPES ] );
+      pad_to( offsets[ VERTICES ] );
+      if( h.vertex_count )   add( &library.all_vertices()[0], sizes[ VERTICES ] );
+      pad_to( offsets[ ASTEROIDS ] );
+      if( h.asteroid_count ) add( world.asteroids.begin(),    sizes[ ASTEROIDS ] );
+      pad_to( offsets[ PARTICLES ] );
+      if( h.particle_count ) add( &records[0],                sizes[ PARTICLES ] );
+      pad_to( offsets[ FLOATS ] );
+
+      for( uint32_t i = 0; i < h.particle_count; i++ )
+        if( !world.particles[i].is_clean )
+          add( world.particles[i].x, 4 * uint64_t( world.particles[i].count ) * sizeof( float ) );
+
+      pad_to( h.file_size );
+
+      int fd = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+      if( fd < 0 ) return( false );
+
+      bool ok = write_all( fd, pieces );
+
+      return( close( fd ) == 0 && ok );
+    }
+
+    // Replaces everything in the world (and the shape library) with a
+    // saved snapshot. Leaves both alone and returns false if the file
+    // is missing, truncated, written by a build with other layouts or
+    // holds an index that points outside its table.
+    inline bool load( World &world, const char *path )
+    {
+      int fd = open( path, O_RDONLY );
+      if( fd < 0 ) return( false );
+
+      struct stat info;
+      if( fstat( fd, &info ) != 0 || size_t( info.st_size ) < sizeof( Header ) )
+      {
+        close( fd );
+        return( false );
+      }
+
+      size_t length = size_t( info.st_size );
+      void  *mapped = mmap( NULL, length, PROT_READ, MAP_PRIVATE, fd, 0 );
+      close( fd );
+
+      if( mapped == MAP_FAILED ) return( false );
+
+      const char *base = (const char*)mapped;
+      Header      h;
+      memcpy( &h, base, sizeof( h ) );
+
+      uint64_t offsets[ SECTION_COUNT ], sizes[ SECTION_COUNT ];
+
+      bool ok = memcmp( h.magic, "ASTS", 4 ) == 0 && h.version == VERSION &&
+                h.asteroid_size == sizeof( Asteroid ) && h.particle_size == sizeof( ParticleRecord ) &&
+                h.shape_size == sizeof( ShapeLibrary::Shape ) && h.class_size == sizeof( ShapeLibrary::SizeClass ) &&
+                h.real_is_fixed == uint32_t( std::is_same< Real, Fixed >::value ) &&
+                h.class_count <= INT_MAX && h.shape_count <= INT_MAX && h.vertex_count <= INT_MAX &&
+                h.asteroid_count <= INT_MAX && h.particle_count <= INT_MAX &&
+                h.file_size == length && layout( h, offsets, sizes ) == length;
+
+      // Only now are the offsets known to be set and inside the file
+      const ShapeLibrary::SizeClass *classes   = (const ShapeLibrary::SizeClass*)( base + offsets[ CLASSES ] );
+      const ShapeLibrary::Shape     *shapes    = (const ShapeLibrary::Shape*)( base + offsets[ SHAPES ] );
+      const Asteroid                *asteroids = (const Asteroid*)( base + offsets[ ASTEROIDS ] );
+      const ParticleRecord          *records   = (const ParticleRecord*)( base + offsets[ PARTICLES ] );
+
+      // Every index has to land inside the table it points into:
+      // shapes into the vertices, size classes into the shapes, and
+      // asteroids into the shapes, with the side count they were cut to.
+      // Side counts also have to fit the outline arrays that collision
+      // and drawing copy shapes into.
+      for( uint32_t i = 0; ok && i < h.shape_count; i++ )
+        ok = shapes[i].offset >= 0 &&
+             shapes[i].sides >= ShapeLibrary::MIN_SIDES && shapes[i].sides <= Collision::MAX_SIDES &&
+             uint64_t( shapes[i].offset ) + uint64_t( shapes[i].sides ) <= h.vertex_count;
+
+      for( uint32_t i = 0; ok && i < h.class_count; i++ )
+        ok = classes[i].first >= 0 && classes[i].count > 0 &&
+             uint64_t( classes[i].first ) + uint64_t( classes[i].count ) <= h.shape_count;
+
+      for( uint32_t i = 0; ok && i < h.asteroid_count; i++ )
+        ok = asteroids[i].shape >= 0 && uint32_t( asteroids[i].shape ) < h.shape_count &&
+             asteroids[i].sides == shapes[ asteroids[i].shape ].sides;
+
+      // The particle counts have to add up to the floats there are
+      uint64_t floats_needed = 0;
+
+      for( uint32_t i = 0; ok && i < h.particle_count; i++ )
+      {
+        ok = records[i].count >= 0;
+        if( !records[i].is_clean )
+          floats_needed += 4 * uint64_t( records[i].count );
+      }
+
+      if( !ok || floats_needed != h.float_count )
+      {
+        munmap( mapped, length );
+        return( false );
+      }
+
+      ShapeLibrary &library = ShapeLibrary::shared();
+
+      library.shapes_per_class = int( h.shapes_per_class );
+      library.restore( (const Point<>*)( base + offsets[ VERTICES ] ), int( h.vertex_count ),
+                       shapes, int( h.shape_count ), classes, int( h.class_count ),
+                       h.library_random );
+
+      world.clear();
+      world.asteroids.append( asteroids, int( h.asteroid_count ) );
+
+      const float *floats = (const float*)( base + offsets[ FLOATS ] );
+
+      world.particles.reserve( int( h.particle_count ) );
+
+      for( uint32_t i = 0; i < h.particle_count; i++ )
+      {
+        const ParticleRecord &record = records[i];
+
+        ParticleSystem p( record.count, record.is_clean ? NULL : floats );
+        if( !record.is_clean )
+          floats += 4 * record.count;
+
+        p.location       = record.location;
+        memcpy( p.lanes, record.lanes, sizeof( p.lanes ) );
+        p.r.state        = record.random;
+        p.velocity_range = record.velocity_range;
+        p.display_count  = record.display_count;
+        p.display_max    = record.display_max;
+        p.chaos          = record.chaos;
+        memcpy( p.color, record.color, sizeof( p.color ) );
+        p.opacity        = record.opacity;
+        p.is_paused      = record.is_paused != 0;
+
+        world.particles.insert( std::move( p ) );
+      }
+
+      world.ratio[0]          = h.ratio[0];
+      world.ratio[1]          = h.ratio[1];
+      world.is_paused         = h.is_paused != 0;
+      world.budget.density    = h.particle_density;
+      world.ticks             = (unsigned long)h.ticks;
+      world.explosions        = (unsigned long)h.explosions;
+      world.random.state      = h.world_random;
+      world.grid_dirty        = true;
+
+      random_seed_sequence() = h.seed_sequence;
+
+      munmap( mapped, length );
+
+      return( true );
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,657 @@
+#ifndef SOFTWARE_RENDERER_H
+#define SOFTWARE_RENDERER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#include "World.h"
+#include "DrawList.h"
+#include "Clock.h"
+#include "ThreadPool.h"
+
+namespace Graphics
+{
+  /* Draws a World into an RGBA buffer in memory, with no GL at all,  */
+  /* so frames can be rendered (and saved as PPM or PNG) on machines  */
+  /* with no display or GPU. It draws the same DrawList as the GL     */
+  /* Renderer and follows the GL state PulsatingStars sets up:         */
+  /*                                                                  */
+  /*   fills    solid black triangles, sampled at pixel centres       */
+  /*   outlines white, line_width pixels wide, anti-aliased by        */
+  /*            distance to the segment like GL_LINE_SMOOTH           */
+  /*   trails   one pixel per step along the major axis, the color    */
+  /*            and alpha blended from one end to the other           */
+  /*   points   one pixel each                                        */
+  /*                                                                  */
+  /* Everything is blended as GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA.   */
+  /* The view fits the whole field into the image, centred, with the  */
+  /* field's aspect ratio kept.                                       */
+  /*                                                                  */
+  /* Given a ThreadPool, the image is cut into bands of rows and each */
+  /* primitive is binned into the bands it touches. Bands are drawn   */
+  /* in parallel, each in the original order, so the result is the    */
+  /* same pixel for pixel as drawing on one thread.                   */
+  class SoftwareRenderer
+  {
+  public:
+    DrawList list;
+    float    line_width; // In pixels
+
+    ThreadPool *pool;        // Draws bands in parallel when set
+    int         band_height; // Rows per band
+
+    double build_time;  // Seconds spent building the last frame's list
+    double raster_time; // and rasterizing it
+
+    SoftwareRenderer( int width, int height )
+    {
+      this->line_width  = 2;
+      this->pool        = NULL;
+      this->band_height = 32;
+      this->build_time  = 0;
+      this->raster_time = 0;
+
+      this->resize( width, height );
+    }
+
+    void resize( int width, int height )
+    {
+      this->width  = width;
+      this->height = height;
+
+      this->pixels.assign( size_t( width ) * height * 4, 0 );
+    }
+
+    int get_width()  const { return( this->width ); }
+    int get_height() const { return( this->height ); }
+
+    // Rows top to bottom, 4 bytes per pixel
+    const unsigned char *rgba() const
+    {
+      return( &this->pixels[0] );
+    }
+
+    // Clears the buffer and draws the world "alpha" of the way between
+    // its last two states
+    void draw( World &world, float alpha )
+    {
+      double start = now_in_seconds();
+      this->list.build( world, alpha );
+      double built = now_in_seconds();
+
+      this->fit_view( world.ratio[0], world.ratio[1] );
+      memset( &this->pixels[0], 0, this->pixels.size() );
+
+      if( this->pool == NULL || this->pool->size() == 1 )
+        this->draw_rows( 0, this->height - 1, NULL );
+      else
+      {
+        this->bin();
+
+        this->pool->parallel_for( int( this->bands.size() ), 1, [&]( int begin, int end )
+        {
+          for( int b = begin; b < end; b++ )
+          {
+            int top    = b * this->band_height;
+            int bottom = top + this->band_height - 1;
+
+            this->draw_rows( top, bottom < this->height ? bottom : this->height - 1, &this->bands[b] );
+          }
+        } );
+      }
+
+      this->build_time  = built - start;
+      this->raster_time = now_in_seconds() - built;
+    }
+
+    // Binary PPM (P6), RGB only
+    bool write_ppm( const char *path ) const
+    {
+      FILE *file = fopen( path, "wb" );
+      if( file == NULL ) return( false );
+
+      fprintf( file, "P6\n%d %d\n255\n", this->width, this->height );
+
+      std::vector<unsigned char> row( this->width * 3 );
+      for( int y = 0; y < this->height; y++ )
+      {
+        this->rgb_row( y, &row[0] );
+        fwrite( &row[0], 1, row.size(), file );
+      }
+
+      return( fclose( file ) == 0 );
+    }
+
+    // RGB PNG. The image data is stored rather than compressed, so no
+    // zlib is needed; it is meant for diffing, not for keeping.
+    bool write_png( const char *path ) const
+    {
+      FILE *file = fopen( path, "wb" );
+      if( file == NULL ) return( false );
+
+      static const unsigned char SIGNATURE[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+      fwrite( SIGNATURE, 1, 8, file );
+
+      unsigned char header[13];
+      put_u32( header, this->width );
+      put_u32( header + 4, this->height );
+      header[8]  = 8; // Bits per channel
+      header[9]  = 2; // RGB
+      header[10] = header[11] = header[12] = 0;
+      write_chunk( file, "IHDR", header, 13 );
+
+      // Each row is a filter byte (0, none) followed by its pixels
+      size_t row_size = size_t( this->width ) * 3 + 1;
+      std::vector<unsigned char> raw( row_size * this->height );
+      for( int y = 0; y < this->height; y++ )
+      {
+        raw[ y * row_size ] = 0;
+        this->rgb_row( y, &raw[ y * row_size + 1 ] );
+      }
+
+      // zlib stream of stored deflate blocks of up to 65535 bytes
+      std::vector<unsigned char> z;
+      z.push_back( 0x78 );
+      z.push_back( 0x01 );
+
+      for( size_t at = 0; at < raw.size(); )
+      {
+        size_t length = raw.size() - at;
+        if( length > 65535 ) length = 65535;
+
+        z.push_back( at + length == raw.size() ? 1 : 0 );
+        z.push_back( length & 0xff );
+        z.push_back( length >> 8 );
+        z.push_back( ~length & 0xff );
+        z.push_back( ( ~length >> 8 ) & 0xff );
+        z.insert( z.end(), raw.begin() + at, raw.begin() + at + length );
+
+        at += length;
+      }
+
+      unsigned char adler[4];
+      put_u32( adler, adler32( &raw[0], raw.size() ) );
+      z.insert( z.end(), adler, adler + 4 );
+
+      write_chunk( file, "IDAT", &z[0], z.size() );
+      write_chunk( file, "IEND", NULL, 0 );
+
+      return( fclose( file ) == 0 );
+    }
+
+    // Picks the format from the extension (.png, otherwise PPM)
+    bool write( const char *path ) const
+    {
+      size_t length = strlen( path );
+
+      if( length >= 4 && strcmp( path + length - 4, ".png" ) == 0 )
+        return( this->write_png( path ) );
+
+      return( this->write_ppm( path ) );
+    }
+
+  private:
+    // Indices of the primitives that touch one band of rows
+    struct Band
+    {
+      std::vector<int> fills;
+      std::vector<int> lines;
+      std::vector<int> trails;
+      std::vector<int> points;
+    };
+
+    int width;
+    int height;
+    std::vector<unsigned char> pixels;
+    std::vector<Band>          bands;
+
+    // World to pixel: x right, y down, origin in the middle
+    float scale;
+    float center_x;
+    float center_y;
+
+    void fit_view( float field_width, float field_height )
+    {
+      float sx = this->width / field_width;
+      float sy = this->height / field_height;
+
+      this->scale    = sx < sy ? sx : sy;
+      this->center_x = this->width * .5f;
+      this->center_y = this->height * .5f;
+    }
+
+    float to_x( float x ) const { return( this->center_x + x * this->scale ); }
+    float to_y( float y ) const { return( this->center_y - y * this->scale ); }
+
+    // Draws rows top..bottom: every primitive, or only those in "band"
+    void draw_rows( int top, int bottom, const Band *band )
+    {
+      static const unsigned char BLACK[4] = { 0, 0, 0, 255 };
+      static const unsigned char WHITE[4] = { 255, 255, 255, 255 };
+
+      const float2        *f = this->list.fills.empty()  ? NULL : &this->list.fills[0];
+      const float2        *l = this->list.lines.empty()  ? NULL : &this->list.lines[0];
+      const float2        *t = this->list.trails.empty() ? NULL : &this->list.trails[0];
+      const unsigned char *u = this->list.trail_colors.empty() ? NULL : &this->list.trail_colors[0];
+      const float2        *p = this->list.points.empty() ? NULL : &this->list.points[0];
+      const unsigned char *c = this->list.colors.empty() ? NULL : &this->list.colors[0];
+
+      int fills  = band ? int( band->fills.size() )  : this->list.fill_vertices() / 3;
+      int lines  = band ? int( band->lines.size() )  : this->list.line_vertices() / 2;
+      int trails = band ? int( band->trails.size() ) : this->list.trail_vertices() / 2;
+      int points = band ? int( band->points.size() ) : this->list.point_vertices();
+
+      for( int k = 0; k < fills; k++ )
+      {
+        const float2 *v = f + 3 * ( band ? band->fills[k] : k );
+        this->fill_triangle( this->to_x( v[0].x ), this->to_y( v[0].y ), this->to_x( v[1].x ), this->to_y( v[1].y ),
+                             this->to_x( v[2].x ), this->to_y( v[2].y ), BLACK, top, bottom );
+      }
+
+      for( int k = 0; k < lines; k++ )
+      {
+        const float2 *v = l + 2 * ( band ? band->lines[k] : k );
+        this->draw_line( this->to_x( v[0].x ), this->to_y( v[0].y ), this->to_x( v[1].x ), this->to_y( v[1].y ), WHITE, top, bottom );
+      }
+
+      for( int k = 0; k < trails; k++ )
+      {
+        int i = band ? band->trails[k] : k;
+        const float2 *v = t + 2*i;
+        this->draw_trail( this->to_x( v[0].x ), this->to_y( v[0].y ), this->to_x( v[1].x ), this->to_y( v[1].y ),
+                          u + 8*i, top, bottom );
+      }
+
+      for( int k = 0; k < points; k++ )
+      {
+        int i = band ? band->points[k] : k;
+        this->plot( this->to_x( p[i].x ), this->to_y( p[i].y ), c + 4*i, top, bottom );
+      }
+    }
+
+    // Sorts every primitive into the bands its rows fall in
+    void bin()
+    {
+      int count = ( this->height + this->band_height - 1 ) / this->band_height;
+      this->bands.resize( count );
+
+      for( int b = 0; b < count; b++ )
+      {
+        this->bands[b].fills.clear();
+        this->bands[b].lines.clear();
+        this->bands[b].trails.clear();
+        this->bands[b].points.clear();
+      }
+
+      const float2 *f = this->list.fills.empty() ? NULL : &this->list.fills[0];
+      for( int i = 0, n = this->list.fill_vertices() / 3; i < n; i++, f += 3 )
+      {
+        float y0 = this->to_y( f[0].y ), y1 = this->to_y( f[1].y ), y2 = this->to_y( f[2].y );
+        this->add_to_bands( &Band::fills, i, min3( y0, y1, y2 ), max3( y0, y1, y2 ) );
+      }
+
+      float reach = this->line_width * .5f + 1;
+
+      const float2 *l = this->list.lines.empty() ? NULL : &this->list.lines[0];
+      for( int i = 0, n = this->list.line_vertices() / 2; i < n; i++, l += 2 )
+      {
+        float y0 = this->to_y( l[0].y ), y1 = this->to_y( l[1].y );
+        this->add_to_bands( &Band::lines, i, ( y0 < y1 ? y0 : y1 ) - reach, ( y0 > y1 ? y0 : y1 ) + reach );
+      }
+
+      const float2 *t = this->list.trails.empty() ? NULL : &this->list.trails[0];
+      for( int i = 0, n = this->list.trail_vertices() / 2; i < n; i++, t += 2 )
+      {
+        float y0 = this->to_y( t[0].y ), y1 = this->to_y( t[1].y );
+        this->add_to_bands( &Band::trails, i, y0 < y1 ? y0 : y1, y0 > y1 ? y0 : y1 );
+      }
+
+      const float2 *p = this->list.points.empty() ? NULL : &this->list.points[0];
+      for( int i = 0, n = this->list.point_vertices(); i < n; i++, p++ )
+      {
+        float y = this->to_y( p->y );
+        this->add_to_bands( &Band::points, i, y, y );
+      }
+    }
+
+    void add_to_bands( std::vector<int> Band::*kind, int index, float top, float bottom )
+    {
+      int last  = int( this->bands.size() ) - 1;
+      int first = clamp( floor_int( top ) / this->band_height, 0, last );
+      int end   = clamp( floor_int( bottom ) / this->band_height, 0, last );
+
+      if( bottom < 0 || top >= this->height ) return;
+
+      for( int b = first; b <= end; b++ )
+        ( this->bands[b].*kind ).push_back( index );
+    }
+
+    // dst = src * a + dst * ( 1 - a ), for every channel including alpha
+    static void blend( unsigned char *d, const unsigned char *c, int a )
+    {
+      blend( d, c[0], c[1], c[2], a );
+    }
+
+    static void blend( unsigned char *d, int r, int g, int b, int a )
+    {
+      if( a >= 255 )
+      {
+        d[0] = r; d[1] = g; d[2] = b; d[3] = 255;
+        return;
+      }
+
+      int keep = 255 - a;
+
+      d[0] = div255( r * a + d[0] * keep );
+      d[1] = div255( g * a + d[1] * keep );
+      d[2] = div255( b * a + d[2] * keep );
+      d[3] = div255( a * a + d[3] * keep );
+    }
+
+    // Rounded x / 255 for x in [0, 255 * 255]
+    static unsigned char div255( int x )
+    {
+      x += 128;
+      return( (unsigned char)( ( x + ( x >> 8 ) ) >> 8 ) );
+    }
+
+    void plot( float x, float y, const unsigned char *c, int top, int bottom )
+    {
+      if( !( x >= 0 && y >= top && x < this->width && y < bottom + 1 ) ) return;
+
+      blend( &this->pixels[ ( size_t( y ) * this->width + size_t( x ) ) * 4 ], c, c[3] );
+    }
+
+    // Covers the pixels whose centres are inside the triangle. Each
+    // edge function is linear along a row, so every row is one span
+    // found from where the three edges cross it.
+    void fill_triangle( float x0, float y0, float x1, float y1, float x2, float y2, const unsigned char *c,
+                        int top, int bottom )
+    {
+      float area = ( x1 - x0 ) * ( y2 - y0 ) - ( y1 - y0 ) * ( x2 - x0 );
+      if( area == 0 ) return;
+
+      if( area < 0 )
+      {
+        float t;
+        t = x1; x1 = x2; x2 = t;
+        t = y1; y1 = y2; y2 = t;
+      }
+
+      int min_x = clamp( floor_int( min3( x0, x1, x2 ) ), 0, this->width - 1 );
+      int max_x = clamp( ceil_int( max3( x0, x1, x2 ) ), 0, this->width - 1 );
+      int min_y = clamp( floor_int( min3( y0, y1, y2 ) ), top, bottom );
+      int max_y = clamp( ceil_int( max3( y0, y1, y2 ) ), top, bottom );
+
+      if( min_x > max_x || min_y > max_y ) return;
+
+      // Edge i is >= 0 on the inside; stepping one pixel right adds
+      // step_x[i], one pixel down adds step_y[i]
+      float step_x[3] = { y1 - y2, y2 - y0, y0 - y1 };
+      float step_y[3] = { x2 - x1, x0 - x2, x1 - x0 };
+
+      float px = min_x + .5f;
+      float py = min_y + .5f;
+
+      float row[3] = { ( x2 - x1 ) * ( py - y1 ) - ( y2 - y1 ) * ( px - x1 ),
+                       ( x0 - x2 ) * ( py - y2 ) - ( y0 - y2 ) * ( px - x2 ),
+                       ( x1 - x0 ) * ( py - y0 ) - ( y1 - y0 ) * ( px - x0 ) };
+
+      for( int y = min_y; y <= max_y; y++ )
+      {
+        // Offsets from min_x where all three edges are >= 0
+        float from = 0;
+        float to   = float( max_x - min_x );
+
+        for( int e = 0; e < 3; e++ )
+        {
+          if( step_x[e] > 0 )
+          {
+            float at = -row[e] / step_x[e];
+            if( at > from ) from = at;
+          }
+          else if( step_x[e] < 0 )
+          {
+            float at = row[e] / -step_x[e];
+            if( at < to ) to = at;
+          }
+          else if( row[e] < 0 )
+            to = -1;
+
+          row[e] += step_y[e];
+        }
+
+        if( from > to ) continue;
+
+        int first = min_x + ceil_int( from );
+        int last  = min_x + floor_int( to );
+
+        unsigned char *d = &this->pixels[ ( size_t( y ) * this->width + first ) * 4 ];
+        for( int x = first; x <= last; x++, d += 4 )
+          blend( d, c, c[3] );
+      }
+    }
+
+    // A line_width wide capsule around the segment, with coverage
+    // falling off over the last pixel. Walks the major axis and only
+    // visits the few pixels across the line at each step.
+    void draw_line( float x0, float y0, float x1, float y1, const unsigned char *c, int top, int bottom )
+    {
+      float edge = this->line_width * .5f + .5f; // Coverage reaches 0 here
+      float dx = x1 - x0;
+      float dy = y1 - y0;
+      float length2 = dx * dx + dy * dy;
+
+      if( length2 == 0 ) return;
+
+      float tx = dx / length2, ty = dy / length2; // Gives t in [0, 1] along the segment
+
+      bool steep = fabsf( dy ) > fabsf( dx );
+
+      // Walk along u (the major axis) and across v
+      float u0 = steep ? y0 : x0, v0 = steep ? x0 : y0;
+      float u1 = steep ? y1 : x1, v1 = steep ? x1 : y1;
+      if( u1 < u0 )
+      {
+        float t;
+        t = u0; u0 = u1; u1 = t;
+        t = v0; v0 = v1; v1 = t;
+      }
+
+      float slope  = ( v1 - v0 ) / ( u1 - u0 );
+      float across = edge * sqrtf( 1 + slope * slope );
+
+      // Rows are limited to top..bottom, columns to the image
+      int u_min = steep ? top : 0, u_max = steep ? bottom : this->width - 1;
+      int v_min = steep ? 0 : top, v_max = steep ? this->width - 1 : bottom;
+
+      // Only pixels whose centres can be within "edge" of the segment
+      int u_start = clamp( ceil_int( u0 - edge - .5f ), u_min, u_max );
+      int u_end   = clamp( floor_int( u1 + edge - .5f ), u_min, u_max );
+
+      for( int u = u_start; u <= u_end; u++ )
+      {
+        float cu = u + .5f;
+        float at = cu < u0 ? u0 : cu > u1 ? u1 : cu;
+        float cv = v0 + slope * ( at - u0 );
+
+        int v_start = clamp( ceil_int( cv - across - .5f ), v_min, v_max );
+        int v_end   = clamp( floor_int( cv + across - .5f ), v_min, v_max );
+
+        for( int v = v_start; v <= v_end; v++ )
+        {
+          float px = ( steep ? v + .5f : cu ) - x0;
+          float py = ( steep ? cu : v + .5f ) - y0;
+
+          // Nearest point on the segment, without branches: which
+          // case a pixel falls in is too random to predict
+          float t = px * tx + py * ty;
+          t = t < 0 ? 0 : t > 1 ? 1 : t;
+
+          float ex = px - t * dx;
+          float ey = py - t * dy;
+
+          float coverage = edge - sqrtf( ex * ex + ey * ey );
+          if( coverage <= 0 ) continue;
+          if( coverage > 1 ) coverage = 1;
+
+          int x = steep ? v : u;
+          int y = steep ? u : v;
+
+          blend( &this->pixels[ ( size_t( y ) * this->width + x ) * 4 ], c, int( coverage * c[3] + .5f ) );
+        }
+      }
+    }
+
+    // A one pixel line from c (an RGBA color at each end) stepped
+    // along its major axis, blending the colors as it goes. The first
+    // pixel is left to the particle's point, which covers it.
+    void draw_trail( float x0, float y0, float x1, float y1, const unsigned char *c, int top, int bottom )
+    {
+      float dx = x1 - x0;
+      float dy = y1 - y0;
+      float ax = dx < 0 ? -dx : dx;
+      float ay = dy < 0 ? -dy : dy;
+
+      int steps = ceil_int( ax > ay ? ax : ay );
+      if( steps < 1 ) return;
+      if( steps > this->width + this->height ) steps = this->width + this->height;
+
+      // Position and color advance by a fixed amount per pixel; the
+      // color in 16.16 fixed point, kept in registers
+      float per = 1.0f / steps;
+      float sx  = dx * per;
+      float sy  = dy * per;
+
+      int sr = int( ( c[4] - c[0] ) * 65536 * per );
+      int sg = int( ( c[5] - c[1] ) * 65536 * per );
+      int sb = int( ( c[6] - c[2] ) * 65536 * per );
+      int sa = int( ( c[7] - c[3] ) * 65536 * per );
+
+      int r = c[0] * 65536 + sr;
+      int g = c[1] * 65536 + sg;
+      int b = c[2] * 65536 + sb;
+      int a = c[3] * 65536 + sa;
+
+      float x = x0 + sx;
+      float y = y0 + sy;
+
+      for( int k = 1; k <= steps; k++, x += sx, y += sy, r += sr, g += sg, b += sb, a += sa )
+      {
+        if( x >= 0 && y >= top && x < this->width && y < bottom + 1 )
+          blend( &this->pixels[ ( size_t( y ) * this->width + size_t( x ) ) * 4 ], r >> 16, g >> 16, b >> 16, a >> 16 );
+      }
+    }
+
+    void rgb_row( int y, unsigned char *out ) const
+    {
+      const unsigned char *in = &this->pixels[ size_t( y ) * this->width * 4 ];
+
+      for( int x = 0; x < this->width; x++, in += 4, out += 3 )
+      {
+        out[0] = in[0];
+        out[1] = in[1];
+        out[2] = in[2];
+      }
+    }
+
+    // floorf and ceilf are library calls without SSE4.1
+    static int floor_int( float f )
+    {
+      int i = int( f );
+      return( f < i ? i - 1 : i );
+    }
+
+    static int ceil_int( float f )
+    {
+      int i = int( f );
+      return( f > i ? i + 1 : i );
+    }
+
+    static int clamp( int v, int lo, int hi )
+    {
+      return( v < lo ? lo : v > hi ? hi : v );
+    }
+
+    static float min3( float a, float b, float c )
+    {
+      float m = a < b ? a : b;
+      return( m < c ? m : c );
+    }
+
+    static float max3( float a, float b, float c )
+    {
+      float m = a > b ? a : b;
+      return( m > c ? m : c );
+    }
+
+    static void put_u32( unsigned char *out, uint32_t v )
+    {
+      out[0] = v >> 24;
+      out[1] = v >> 16;
+      out[2] = v >> 8;
+      out[3] = v;
+    }
+
+    static uint32_t crc32( uint32_t crc, const unsigned char *data, size_t length )
+    {
+      static uint32_t table[256];
+      static bool     has_table = false;
+
+      if( !has_table )
+      {
+        for( uint32_t n = 0; n < 256; n++ )
+        {
+          uint32_t c = n;
+          for( int k = 0; k < 8; k++ )
+            c = c & 1 ? 0xedb88320u ^ ( c >> 1 ) : c >> 1;
+
+          table[n] = c;
+        }
+
+        has_table = true;
+      }
+
+      crc = ~crc;
+      for( size_t i = 0; i < length; i++ )
+        crc = table[ ( crc ^ data[i] ) & 0xff ] ^ ( crc >> 8 );
+
+      return( ~crc );
+    }
+
+    static uint32_t adler32( const unsigned char *data, size_t length )
+    {
+      uint32_t a = 1, b = 0;
+
+      for( size_t i = 0; i < length; i++ )
+      {
+        a = ( a + data[i] ) % 65521;
+        b = ( b + a ) % 65521;
+      }
+
+      return( ( b << 16 ) | a );
+    }
+
+    static void write_chunk( FILE *file, const char *type, const unsigned char *data, size_t length )
+    {
+      unsigned char word[4];
+
+      put_u32( word, uint32_t( length ) );
+      fwrite( word, 1, 4, file );
+      fwrite( type, 1, 4, file );
+      if( length > 0 )
+        fwrite( data, 1, length, file );
+
+      uint32_t crc = crc32( 0, (const unsigned char*)type, 4 );
+      crc = crc32( crc, data, length );
+
+      put_u32( word, crc );
+      fwrite( word, 1, 4, file );
+    }
+  };
+}
+
+#endif
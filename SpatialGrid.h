@@ -0,0 +1,456 @@
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <math.h>
+
+#include "Point.h"
+
+namespace Graphics
+{
+  /* A uniform grid over the playing field, rebuilt from scratch each */
+  /* tick with a counting sort (entries end up grouped by cell in one */
+  /* array). The field is treated as a torus, matching the wrap in    */
+  /* Asteroid::check_boundaries(): positions just past an edge land   */
+  /* in the cells on the opposite side, and queries near an edge      */
+  /* wrap around to look there too.                                   */
+  /*                                                                  */
+  /* Queries return candidates: every item whose bounding circle may  */
+  /* touch the query shape (distances measured the short way around   */
+  /* the torus). Callers still do their own exact test.               */
+  /*                                                                  */
+  /* Items are referred to by their index in the container the grid   */
+  /* was built from, so the grid is stale once that container changes.*/
+  /* Cells are at least as wide as the biggest item, so any two items */
+  /* that touch are in the same or neighbouring cells.                */
+  class SpatialGrid
+  {
+  public:
+    int   columns, rows;
+    float cell_width, cell_height;
+    float width, height;   // Size of the field
+    float max_reach;       // Largest bounding radius of any item
+
+    int   count;           // Items in the grid
+
+    SpatialGrid()
+    {
+      this->columns = this->rows = 0;
+      this->cell_width = this->cell_height = 0;
+      this->width = this->height = 0;
+      this->max_reach = 0;
+      this->count     = 0;
+
+      this->cell_start = NULL;
+      this->entries    = NULL;
+      this->centers    = NULL;
+      this->reaches    = NULL;
+      this->cell_of    = NULL;
+      this->sorted     = NULL;
+
+      this->cell_capacity  = 0;
+      this->entry_capacity = 0;
+    }
+
+    ~SpatialGrid()
+    {
+      delete [] this->cell_start;
+      delete [] this->entries;
+      delete [] this->centers;
+      delete [] this->reaches;
+      delete [] this->cell_of;
+      delete [] this->sorted;
+    }
+
+    // Bins every item of "items" (anything indexable with a location
+    // and a hit_radius()) into a w x h field centred on the origin.
+    // Cells are about cell_size across; by default they are sized so
+    // each one holds a couple of items. They are never narrower than
+    // the biggest item.
+    template< typename Items >
+    void build( Items &items, int n, float w, float h, float cell_size = 0 )
+    {
+      this->width     = w;
+      this->height    = h;
+      this->count     = n;
+      this->max_reach = 0;
+
+      this->reserve_entries( n );
+
+      for( int i = 0; i < n; i++ )
+      {
+        float reach = items[i].hit_radius();
+
+        if( reach > this->max_reach )
+          this->max_reach = reach;
+      }
+
+      if( cell_size <= 0 )
+        cell_size = sqrtf( w * h * 2 / ( n > 0 ? n : 1 ) );
+
+      if( cell_size < 2 * this->max_reach )
+        cell_size = 2 * this->max_reach;
+
+      this->columns     = this->clamp_cells( w / cell_size );
+      this->rows        = this->clamp_cells( h / cell_size );
+      this->cell_width  = w / this->columns;
+      this->cell_height = h / this->rows;
+
+      int cells = this->columns * this->rows;
+      this->reserve_cells( cells );
+
+      // Counting sort: count per cell, prefix sum, then scatter
+      for( int c = 0; c <= cells; c++ )
+        this->cell_start[c] = 0;
+
+      for( int i = 0; i < n; i++ )
+      {
+        this->cell_of[i] = this->cell_index( to_float( items[i].location ) );
+        this->cell_start[ this->cell_of[i] + 1 ]++;
+      }
+
+      for( int c = 0; c < cells; c++ )
+        this->cell_start[c + 1] += this->cell_start[c];
+
+      // Entries carry a copy of their item's centre and reach, so the
+      // queries below walk memory in cell order
+      for( int i = 0; i < n; i++ )
+      {
+        int e = this->cell_start[ this->cell_of[i] ]++;
+
+        this->entries[e] = i;
+        this->centers[e] = to_float( items[i].location );
+        this->reaches[e] = items[i].hit_radius();
+      }
+
+      for( int e = 0; e < n; e++ )
+        this->sorted[ this->entries[e] ] = e;
+
+      // Scattering advanced each start to the next cell's; shift back
+      for( int c = cells; c > 0; c-- )
+        this->cell_start[c] = this->cell_start[c - 1];
+      this->cell_start[0] = 0;
+    }
+
+    // Calls f( index ) for each candidate whose bounding circle may
+    // touch the circle at "center". Stops early if f returns false.
+    // The visitor is taken by reference, so one that counts or
+    // collects (like Collector) keeps what it saw.
+    template< typename F >
+    void each_in_circle( Point<> center, float radius, F &&f )
+    {
+      if( this->count == 0 ) return;
+
+      float reach = radius + this->max_reach;
+
+      int x0, x1, y0, y1;
+      this->cell_span( center.x - reach, center.x + reach, this->columns, this->cell_width,  -this->width / 2,  x0, x1 );
+      this->cell_span( center.y - reach, center.y + reach, this->rows,    this->cell_height, -this->height / 2, y0, y1 );
+
+      for( int cy = y0; cy <= y1; cy++ )
+      {
+        int row = wrap( cy, this->rows ) * this->columns;
+
+        for( int cx = x0; cx <= x1; cx++ )
+        {
+          int cell = row + wrap( cx, this->columns );
+
+          for( int e = this->cell_start[ cell ]; e < this->cell_start[ cell + 1 ]; e++ )
+          {
+            float dx = wrapped( this->centers[e].x - center.x, this->width );
+            float dy = wrapped( this->centers[e].y - center.y, this->height );
+            float r  = radius + this->reaches[e];
+
+            if( dx*dx + dy*dy <= r*r && !f( this->entries[e] ) )
+              return;
+          }
+        }
+      }
+    }
+
+    template< typename F >
+    void each_at_point( Point<> p, F &&f )
+    {
+      this->each_in_circle( p, 0, f );
+    }
+
+    // Candidates whose bounding box overlaps the rectangle [min, max]
+    template< typename F >
+    void each_in_rect( Point<> min, Point<> max, F &&f )
+    {
+      if( this->count == 0 ) return;
+
+      Point<> center( ( min.x + max.x ) / 2, ( min.y + max.y ) / 2 );
+      float   half_w = ( max.x - min.x ) / 2;
+      float   half_h = ( max.y - min.y ) / 2;
+
+      int x0, x1, y0, y1;
+      this->cell_span( min.x - this->max_reach, max.x + this->max_reach, this->columns, this->cell_width,  -this->width / 2,  x0, x1 );
+      this->cell_span( min.y - this->max_reach, max.y + this->max_reach, this->rows,    this->cell_height, -this->height / 2, y0, y1 );
+
+      for( int cy = y0; cy <= y1; cy++ )
+      {
+        int row = wrap( cy, this->rows ) * this->columns;
+
+        for( int cx = x0; cx <= x1; cx++ )
+        {
+          int cell = row + wrap( cx, this->columns );
+
+          for( int e = this->cell_start[ cell ]; e < this->cell_start[ cell + 1 ]; e++ )
+          {
+            float dx = fabsf( wrapped( this->centers[e].x - center.x, this->width ) );
+            float dy = fabsf( wrapped( this->centers[e].y - center.y, this->height ) );
+
+            if( dx <= half_w + this->reaches[e] && dy <= half_h + this->reaches[e] && !f( this->entries[e] ) )
+              return;
+          }
+        }
+      }
+    }
+
+    // Calls f( i, j ) once for every pair of items whose bounding
+    // circles overlap. Each cell is paired with itself and with the
+    // four neighbours ahead of it (right, and the three above), which
+    // covers every neighbouring pair exactly once.
+    template< typename F >
+    void each_pair( F f )
+    {
+      if( this->count == 0 ) return;
+
+      static const int OFFSETS[4][2] = { { 1, 0 }, { -1, 1 }, { 0, 1 }, { 1, 1 } };
+
+      // With fewer than three cells along an axis, neighbours would
+      // repeat around the wrap; fall back to one query per item
+      if( this->columns < 3 || this->rows < 3 )
+      {
+        for( int e = 0; e < this->count; e++ )
+        {
+          int i = this->entries[e];
+
+          this->each_in_circle( this->centers[e], this->reaches[e], [&]( int j )
+          {
+            if( j > i && this->reach_overlap( i, j ) ) f( i, j );
+            return( true );
+          } );
+        }
+
+        return;
+      }
+
+      const int     *start   = this->cell_start;
+      const Point<> *centers = this->centers;
+      const float   *reaches = this->reaches;
+
+      for( int cy = 0; cy < this->rows; cy++ )
+      {
+        for( int cx = 0; cx < this->columns; cx++ )
+        {
+          int cell  = cy * this->columns + cx;
+          int begin = start[ cell ];
+          int end   = start[ cell + 1 ];
+
+          if( begin == end ) continue;
+
+          bool edge = this->on_border( cx, cy );
+
+          for( int o = -1; o < 4; o++ )
+          {
+            int  other = cell, first = begin;
+            bool seam  = edge;
+
+            if( o >= 0 )
+            {
+              int ox = wrap( cx + OFFSETS[o][0], this->columns );
+              int oy = wrap( cy + OFFSETS[o][1], this->rows );
+
+              other = oy * this->columns + ox;
+              first = start[ other ];
+
+              // Items binned across the wrap sit in border cells, so a
+              // pair needs the short way around if either cell is on
+              // the border; interior pairs skip it
+              seam = edge || this->on_border( ox, oy );
+            }
+
+            int last = start[ other + 1 ];
+
+            for( int a = begin; a < end; a++ )
+            {
+              float ax = centers[a].x, ay = centers[a].y, ar = reaches[a];
+
+              for( int b = ( o < 0 ? a + 1 : first ); b < last; b++ )
+              {
+                float dx = centers[b].x - ax;
+                float dy = centers[b].y - ay;
+                float r  = ar + reaches[b];
+
+                if( seam )
+                {
+                  dx = wrapped( dx, this->width );
+                  dy = wrapped( dy, this->height );
+                }
+
+                if( dx*dx + dy*dy <= r*r )
+                  f( this->entries[a], this->entries[b] );
+              }
+            }
+          }
+        }
+      }
+    }
+
+    // The query_* forms copy up to max_out candidate indices into out
+    // and return how many candidates there were in total
+    int query_point( Point<> p, int *out, int max_out )
+    {
+      Collector c( out, max_out );
+      this->each_at_point( p, c );
+      return( c.found );
+    }
+
+    int query_circle( Point<> center, float radius, int *out, int max_out )
+    {
+      Collector c( out, max_out );
+      this->each_in_circle( center, radius, c );
+      return( c.found );
+    }
+
+    int query_rect( Point<> min, Point<> max, int *out, int max_out )
+    {
+      Collector c( out, max_out );
+      this->each_in_rect( min, max, c );
+      return( c.found );
+    }
+
+    // Shortest signed distance around a torus of the given size
+    static float wrapped( float d, float size )
+    {
+      if( d > size / 2 )       d -= size;
+      else if( d < -size / 2 ) d += size;
+
+      return( d );
+    }
+
+    // Cell an item is binned in, for callers walking cells directly
+    int cell_index( Point<> p )
+    {
+      int cx = wrap( int( floorf( ( p.x + this->width  / 2 ) / this->cell_width ) ),  this->columns );
+      int cy = wrap( int( floorf( ( p.y + this->height / 2 ) / this->cell_height ) ), this->rows );
+
+      return( cy * this->columns + cx );
+    }
+
+  private:
+    int     *cell_start; // Entries of cell c are entries[cell_start[c] .. cell_start[c+1])
+    int     *entries;
+    Point<> *centers;
+    float   *reaches;
+    int     *cell_of;
+    int     *sorted;     // Entry of each item, for the fallback pair walk
+
+    int cell_capacity;
+    int entry_capacity;
+
+    enum { MAX_CELLS_PER_AXIS = 4096 };
+
+    struct Collector
+    {
+      int *out;
+      int  max_out;
+      int  found;
+
+      Collector( int *out, int max_out )
+      {
+        this->out     = out;
+        this->max_out = max_out;
+        this->found   = 0;
+      }
+
+      bool operator()( int i )
+      {
+        if( this->found < this->max_out )
+          this->out[ this->found ] = i;
+
+        this->found++;
+        return( true );
+      }
+    };
+
+    static int wrap( int i, int n )
+    {
+      if( i >= 0 && i < n ) return( i );
+      if( i < 0 && i >= -n ) return( i + n );
+      if( i >= n && i < 2*n ) return( i - n );
+
+      i %= n;
+      return( i < 0 ? i + n : i );
+    }
+
+    bool on_border( int cx, int cy ) const
+    {
+      return( cx == 0 || cy == 0 || cx == this->columns - 1 || cy == this->rows - 1 );
+    }
+
+    bool entries_overlap( int a, int b )
+    {
+      float dx = wrapped( this->centers[b].x - this->centers[a].x, this->width );
+      float dy = wrapped( this->centers[b].y - this->centers[a].y, this->height );
+      float r  = this->reaches[a] + this->reaches[b];
+
+      return( dx*dx + dy*dy <= r*r );
+    }
+
+    bool reach_overlap( int i, int j )
+    {
+      return( this->entries_overlap( this->sorted[i], this->sorted[j] ) );
+    }
+
+    static int clamp_cells( float n )
+    {
+      if( n < 1 ) return( 1 );
+      if( n > MAX_CELLS_PER_AXIS ) return( MAX_CELLS_PER_AXIS );
+
+      return( int( n ) );
+    }
+
+    // Unwrapped range of cells covering [lo, hi] along one axis. If it
+    // spans the whole axis, each cell is visited exactly once.
+    static void cell_span( float lo, float hi, int cells, float cell, float origin, int &first, int &last )
+    {
+      first = int( floorf( ( lo - origin ) / cell ) );
+      last  = int( floorf( ( hi - origin ) / cell ) );
+
+      if( last - first + 1 > cells )
+        last = first + cells - 1;
+    }
+
+    void reserve_entries( int n )
+    {
+      if( n <= this->entry_capacity ) return;
+
+      delete [] this->entries;
+      delete [] this->centers;
+      delete [] this->reaches;
+      delete [] this->cell_of;
+      delete [] this->sorted;
+
+      this->entry_capacity = n * 2;
+      this->entries = new int[ this->entry_capacity ];
+      this->centers = new Point<>[ this->entry_capacity ];
+      this->reaches = new float[ this->entry_capacity ];
+      this->cell_of = new int[ this->entry_capacity ];
+      this->sorted  = new int[ this->entry_capacity ];
+    }
+
+    void reserve_cells( int cells )
+    {
+      if( cells + 1 <= this->cell_capacity ) return;
+
+      delete [] this->cell_start;
+
+      this->cell_capacity = cells + 1;
+      this->cell_start    = new int[ this->cell_capacity ];
+    }
+  };
+}
+
+#endif
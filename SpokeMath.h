@@ -0,0 +1,51 @@
+#ifndef SPOKE_MATH_H
+#define SPOKE_MATH_H
+
+namespace Graphics
+{
+  /* sin and cos of the angle of spoke i of n (360 * i / n degrees),  */
+  /* worked out by the compiler. Only + - * / on doubles go into      */
+  /* them, so every compiler arrives at the same tables: the outline  */
+  /* spokes in Spokes.h and the fixed point sine table in Fixed.h.    */
+  namespace SpokeMath
+  {
+    // Taylor series of sin, summed from "term" (the one in x^(2k-1)) on
+    constexpr double sin_series( double term, double x2, int k )
+    {
+      return( k > 30 ? 0 : term + sin_series( -term * x2 / ( ( 2*k ) * ( 2*k + 1 ) ), x2, k + 1 ) );
+    }
+
+    // For x in [-pi, pi], where the series converges quickly
+    constexpr double sin_folded( double x )
+    {
+      return( sin_series( x, x * x, 1 ) );
+    }
+
+    // The angle is taken half a turn back into [-pi, pi], which flips
+    // the sign; cos is sin a quarter turn on, as spoke 4i + n of 4n so
+    // it stays exact.
+    constexpr double spoke_sin( int i, int n )
+    {
+      return( -sin_folded( 6.283185307179586 * i / n - 3.141592653589793 ) );
+    }
+
+    constexpr double spoke_cos( int i, int n )
+    {
+      return( spoke_sin( ( 4*i + n ) % ( 4*n ), 4*n ) );
+    }
+
+    template< int... I > struct Indices {};
+
+    // Indices< 0, 1, ..., N - 1 >
+    template< int N, int... I >
+    struct MakeIndices : MakeIndices< N - 1, N - 1, I... > {};
+
+    template< int... I >
+    struct MakeIndices< 0, I... >
+    {
+      typedef Indices< I... > type;
+    };
+  }
+}
+
+#endif
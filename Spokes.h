@@ -0,0 +1,85 @@
+#ifndef SPOKES_H
+#define SPOKES_H
+
+#include "Graphics.h"
+#include "SpokeMath.h"
+
+namespace Graphics
+{
+  /* The directions of an outline's vertices. Vertex i of a shape     */
+  /* with n sides lies on the spoke at 360 * i / n degrees, so the    */
+  /* unit vectors along the spokes only depend on n; Spokes<n> holds  */
+  /* them in constexpr tables the compiler works out.                 */
+  /*                                                                  */
+  /* Turning and moving an outline into the world is written for a    */
+  /* fixed number of sides, which the compiler unrolls and            */
+  /* vectorizes. The common side counts (8, 12 and 16) get their own  */
+  /* copy; any other count takes a plain loop with the same results.  */
+  template< int Sides, typename I = typename SpokeMath::MakeIndices< Sides >::type >
+  struct Spokes;
+
+  template< int Sides, int... I >
+  struct Spokes< Sides, SpokeMath::Indices< I... > >
+  {
+    static_assert( Sides >= 3, "an outline needs at least three sides" );
+
+    static constexpr float x[ Sides ] = { float( SpokeMath::spoke_cos( I, Sides ) )... };
+    static constexpr float y[ Sides ] = { float( SpokeMath::spoke_sin( I, Sides ) )... };
+  };
+
+  template< int Sides, int... I >
+  constexpr float Spokes< Sides, SpokeMath::Indices< I... > >::x[ Sides ];
+
+  template< int Sides, int... I >
+  constexpr float Spokes< Sides, SpokeMath::Indices< I... > >::y[ Sides ];
+
+  // Unit vector along spoke i of "sides", from the tables when there
+  // is one and from the same series otherwise
+  inline float2 spoke( int i, int sides )
+  {
+    switch( sides )
+    {
+      case 8:  return( float2( Spokes<8>::x[i],  Spokes<8>::y[i] ) );
+      case 12: return( float2( Spokes<12>::x[i], Spokes<12>::y[i] ) );
+      case 16: return( float2( Spokes<16>::x[i], Spokes<16>::y[i] ) );
+    }
+
+    return( float2( float( SpokeMath::spoke_cos( i, sides ) ), float( SpokeMath::spoke_sin( i, sides ) ) ) );
+  }
+
+  // Writes an outline turned by the angle with sine s and cosine c,
+  // then moved by offset
+  template< int Sides >
+  inline void transform_outline( const float2 *points, float s, float c, float2 offset, float2 *out )
+  {
+    transform( points, Sides, s, c, offset, out );
+  }
+
+  inline void transform_outline( const float2 *points, int sides, float s, float c, float2 offset, float2 *out )
+  {
+    switch( sides )
+    {
+      case 8:  transform_outline<8>( points, s, c, offset, out );  return;
+      case 12: transform_outline<12>( points, s, c, offset, out ); return;
+      case 16: transform_outline<16>( points, s, c, offset, out ); return;
+    }
+
+    transform( points, sides, s, c, offset, out );
+  }
+
+  // Writes an outline "alpha" of the way from one pose to the next:
+  // turned from one rotation to the other (in degrees) and moved from
+  // one centre to the other
+  inline void interpolate_outline( const float2 *points, int sides, float from_rotation, float to_rotation,
+                                   float2 from, float2 to, float alpha, float2 *out )
+  {
+    float angle = ( from_rotation + ( to_rotation - from_rotation ) * alpha ) * PI_OVER_180;
+
+    float s, c;
+    FastMath::sincos( angle, s, c );
+
+    transform_outline( points, sides, s, c, lerp( from, to, alpha ), out );
+  }
+}
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+namespace Graphics
+{
+  /* A fixed size first-in first-out queue between exactly one        */
+  /* producer thread and one consumer thread, with no locks. The      */
+  /* values live in a ring; the producer owns the tail, the consumer  */
+  /* owns the head, and each only ever writes its own. A push is one  */
+  /* copy and a release store of the tail, a pop one acquire load and */
+  /* a copy, so neither side can be held up by the other.             */
+  /*                                                                  */
+  /* The counters run freely and wrap; the capacity is a power of two */
+  /* so a counter masks down to a slot. When the ring is full a push  */
+  /* fails (and is counted) instead of waiting for room.              */
+  template< typename T >
+  class SpscQueue
+  {
+  public:
+    // Room for at least "capacity" values
+    SpscQueue( uint32_t capacity = 256 )
+    {
+      uint32_t size = 1;
+      while( size < capacity )
+        size <<= 1;
+
+      this->slots.resize( size );
+      this->mask = size - 1;
+
+      this->head.store( 0 );
+      this->tail.store( 0 );
+      this->dropped.store( 0 );
+    }
+
+    // Producer: adds a value at the back. Returns false, dropping it,
+    // if the queue is full.
+    bool push( const T &value )
+    {
+      uint32_t tail = this->tail.load( std::memory_order_relaxed );
+
+      if( tail - this->head.load( std::memory_order_acquire ) > this->mask )
+      {
+        this->dropped.store( this->dropped.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+        return( false );
+      }
+
+      this->slots[ tail & this->mask ] = value;
+      this->tail.store( tail + 1, std::memory_order_release );
+
+      return( true );
+    }
+
+    // Consumer: takes the value at the front. Returns false if there
+    // is none.
+    bool pop( T &value )
+    {
+      uint32_t head = this->head.load( std::memory_order_relaxed );
+
+      if( head == this->tail.load( std::memory_order_acquire ) )
+        return( false );
+
+      value = this->slots[ head & this->mask ];
+      this->head.store( head + 1, std::memory_order_release );
+
+      return( true );
+    }
+
+    // Values waiting, from either side. It may be out of date by the
+    // time it returns. The head is read first, so the tail read after
+    // it can only be further on.
+    int size() const
+    {
+      uint32_t head = this->head.load( std::memory_order_acquire );
+
+      return( int( this->tail.load( std::memory_order_acquire ) - head ) );
+    }
+
+    int capacity() const
+    {
+      return( int( this->mask + 1 ) );
+    }
+
+    // Pushes that failed because the queue was full
+    unsigned long dropped_count() const
+    {
+      return( this->dropped.load( std::memory_order_relaxed ) );
+    }
+
+  private:
+    std::vector<T> slots;
+    uint32_t       mask;
+
+    alignas( 64 ) std::atomic<uint32_t> head;    // Next to pop; the consumer's
+    alignas( 64 ) std::atomic<uint32_t> tail;    // Next to push; the producer's
+    std::atomic<unsigned long>          dropped; // The producer's
+
+    SpscQueue( const SpscQueue & );
+    SpscQueue &operator=( const SpscQueue & );
+  };
+}
+
+#endif
@@ -0,0 +1,526 @@
+/************************************************************/
+/* Filename: Tests.cpp                                      */
+/* Checks the public behaviour of the core headers against  */
+/* slow, obviously right versions of the same thing: the    */
+/* SpatialGrid queries against a loop over every item, and  */
+/* its pair walk against a loop over every pair. Also feeds */
+/* the file loaders damaged files they must refuse.         */
+/* Prints one line per test and exits with 1 if any fail.   */
+/*                                                          */
+/* Usage: tests [-f filter]                                 */
+/*                                                          */
+/*   -f  only run tests whose name contains this            */
+/************************************************************/
+
+#define HEADLESS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include "Graphics.h"
+#include "SpatialGrid.h"
+#include "Input.h"
+#include "Snapshot.h"
+
+using namespace Graphics;
+
+// Set by check() when a condition fails, cleared before each test
+bool g_ok;
+
+void check( bool condition, const char *what, int line )
+{
+  if( condition ) return;
+
+  printf( "    line %d: %s\n", line, what );
+  g_ok = false;
+}
+
+#define CHECK( condition ) check( ( condition ), #condition, __LINE__ )
+
+// Deterministic inputs, the same on every run
+struct Inputs
+{
+  unsigned int s;
+
+  Inputs( unsigned int seed )
+  {
+    this->s = seed;
+  }
+
+  // Uniform in [lo, hi)
+  float next( float lo, float hi )
+  {
+    this->s ^= this->s << 13;
+    this->s ^= this->s >> 17;
+    this->s ^= this->s << 5;
+
+    return( lo + ( hi - lo ) * float( this->s >> 8 ) * ( 1.0f / 16777216.0f ) );
+  }
+};
+
+// The least a SpatialGrid needs from the things it indexes
+struct Item
+{
+  Point<> location;
+  float   radius;
+
+  float hit_radius() const
+  {
+    return( this->radius );
+  }
+};
+
+// n items scattered over a w x h field centred on the origin, a
+// quarter of them within a radius of an edge so they straddle the wrap
+std::vector<Item> scatter( int n, float w, float h, float radius, unsigned int seed )
+{
+  Inputs            r( seed );
+  std::vector<Item> items( n );
+
+  for( int i = 0; i < n; i++ )
+  {
+    items[i].location.x = r.next( -w / 2, w / 2 );
+    items[i].location.y = r.next( -h / 2, h / 2 );
+    items[i].radius     = r.next( radius / 4, radius );
+
+    if( i % 8 == 0 ) items[i].location.x = w / 2 - r.next( -radius, radius );
+    if( i % 8 == 1 ) items[i].location.y = -h / 2 + r.next( -radius, radius );
+  }
+
+  return( items );
+}
+
+// Indices of the items whose circles come within "radius" of "center",
+// measured the short way around the torus
+std::vector<int> brute_circle( const std::vector<Item> &items, float w, float h, Point<> center, float radius )
+{
+  std::vector<int> found;
+
+  for( int i = 0; i < int( items.size() ); i++ )
+  {
+    float dx = SpatialGrid::wrapped( items[i].location.x - center.x, w );
+    float dy = SpatialGrid::wrapped( items[i].location.y - center.y, h );
+    float r  = radius + items[i].radius;
+
+    if( dx*dx + dy*dy <= r*r )
+      found.push_back( i );
+  }
+
+  return( found );
+}
+
+std::vector<int> brute_rect( const std::vector<Item> &items, float w, float h, Point<> min, Point<> max )
+{
+  std::vector<int> found;
+  Point<>          center( ( min.x + max.x ) / 2, ( min.y + max.y ) / 2 );
+
+  for( int i = 0; i < int( items.size() ); i++ )
+  {
+    float dx = fabsf( SpatialGrid::wrapped( items[i].location.x - center.x, w ) );
+    float dy = fabsf( SpatialGrid::wrapped( items[i].location.y - center.y, h ) );
+
+    if( dx <= ( max.x - min.x ) / 2 + items[i].radius && dy <= ( max.y - min.y ) / 2 + items[i].radius )
+      found.push_back( i );
+  }
+
+  return( found );
+}
+
+// The first n of out, sorted, for comparing with a brute force answer
+std::vector<int> sorted( const int *out, int n )
+{
+  std::vector<int> v( out, out + n );
+  std::sort( v.begin(), v.end() );
+
+  return( v );
+}
+
+void test_grid_query_overlapping()
+{
+  std::vector<Item> items( 5 );
+
+  for( int i = 0; i < 5; i++ )
+  {
+    items[i].location = Point<>( i < 3 ? .01f * i : 1.5f, i < 3 ? 0 : -1.0f );
+    items[i].radius   = .1f;
+  }
+
+  SpatialGrid grid;
+  grid.build( items, 5, 4, 3 );
+
+  int out[8];
+
+  int n = grid.query_point( Point<>( 0, 0 ), out, 8 );
+  CHECK( n == 3 );
+  CHECK( sorted( out, n ) == std::vector<int>( { 0, 1, 2 } ) );
+
+  n = grid.query_circle( Point<>( 0, 0 ), .05f, out, 8 );
+  CHECK( n == 3 );
+
+  n = grid.query_rect( Point<>( -.2f, -.2f ), Point<>( .2f, .2f ), out, 8 );
+  CHECK( n == 3 );
+  CHECK( sorted( out, n ) == std::vector<int>( { 0, 1, 2 } ) );
+
+  // Past max_out the total is still counted, but only max_out written
+  out[1] = -1;
+  n = grid.query_point( Point<>( 0, 0 ), out, 1 );
+  CHECK( n == 3 );
+  CHECK( out[1] == -1 );
+
+  CHECK( grid.query_point( Point<>( -1.5f, 1.0f ), out, 8 ) == 0 );
+}
+
+void test_grid_query_wraps()
+{
+  std::vector<Item> items( 2 );
+  items[0].location = Point<>( 1.99f, 0 );   // Right edge of a 4 x 3 field
+  items[0].radius   = .05f;
+  items[1].location = Point<>( 0, -1.49f );  // Bottom edge
+  items[1].radius   = .05f;
+
+  SpatialGrid grid;
+  grid.build( items, 2, 4, 3, .25f );
+
+  int out[4];
+
+  CHECK( grid.query_point( Point<>( -1.99f, 0 ), out, 4 ) == 1 && out[0] == 0 );
+  CHECK( grid.query_circle( Point<>( 0, 1.49f ), .01f, out, 4 ) == 1 && out[0] == 1 );
+  CHECK( grid.query_rect( Point<>( -2, -.1f ), Point<>( -1.9f, .1f ), out, 4 ) == 1 && out[0] == 0 );
+}
+
+void test_grid_query_brute_force()
+{
+  const float W = 4, H = 3;
+
+  std::vector<Item> items = scatter( 3000, W, H, .05f, 7 );
+
+  SpatialGrid grid;
+  grid.build( items, int( items.size() ), W, H );
+
+  Inputs           r( 99 );
+  std::vector<int> out( items.size() );
+
+  for( int q = 0; q < 500; q++ )
+  {
+    Point<> p( r.next( -W / 2, W / 2 ), r.next( -H / 2, H / 2 ) );
+    float   radius = r.next( 0, .3f );
+
+    // Every fourth query sits on the seam
+    if( q % 4 == 0 ) p.x = -W / 2 + r.next( -.1f, .1f );
+
+    int n = grid.query_point( p, out.data(), int( out.size() ) );
+    CHECK( sorted( out.data(), n ) == brute_circle( items, W, H, p, 0 ) );
+
+    n = grid.query_circle( p, radius, out.data(), int( out.size() ) );
+    CHECK( sorted( out.data(), n ) == brute_circle( items, W, H, p, radius ) );
+
+    Point<> min( p.x - radius, p.y - radius / 2 ), max( p.x + radius, p.y + radius / 2 );
+
+    n = grid.query_rect( min, max, out.data(), int( out.size() ) );
+    CHECK( sorted( out.data(), n ) == brute_rect( items, W, H, min, max ) );
+
+    if( !g_ok ) return;
+  }
+}
+
+// Every overlapping pair, as ( smaller index, larger index ), sorted
+std::vector< std::pair<int, int> > brute_pairs( const std::vector<Item> &items, float w, float h )
+{
+  std::vector< std::pair<int, int> > pairs;
+
+  for( int i = 0; i < int( items.size() ); i++ )
+    for( int j = i + 1; j < int( items.size() ); j++ )
+    {
+      float dx = SpatialGrid::wrapped( items[j].location.x - items[i].location.x, w );
+      float dy = SpatialGrid::wrapped( items[j].location.y - items[i].location.y, h );
+      float r  = items[i].radius + items[j].radius;
+
+      if( dx*dx + dy*dy <= r*r )
+        pairs.push_back( std::make_pair( i, j ) );
+    }
+
+  return( pairs );
+}
+
+std::vector< std::pair<int, int> > grid_pairs( std::vector<Item> &items, float w, float h )
+{
+  SpatialGrid                        grid;
+  std::vector< std::pair<int, int> > pairs;
+
+  grid.build( items, int( items.size() ), w, h );
+  grid.each_pair( [&]( int i, int j )
+  {
+    pairs.push_back( std::make_pair( std::min( i, j ), std::max( i, j ) ) );
+  } );
+
+  std::sort( pairs.begin(), pairs.end() );
+  return( pairs );
+}
+
+// Items just past an edge are binned in the cells on the other side,
+// so pairs across the seam meet in border cells from interior ones
+void test_grid_pairs_brute_force()
+{
+  const float W = 4, H = 3;
+
+  std::vector<Item> items = scatter( 8000, W, H, .04f, 3 );
+  std::vector< std::pair<int, int> > expected = brute_pairs( items, W, H );
+  std::vector< std::pair<int, int> > found    = grid_pairs( items, W, H );
+
+  CHECK( expected.size() > 1000 );
+  CHECK( std::adjacent_find( found.begin(), found.end() ) == found.end() );
+  CHECK( found == expected );
+}
+
+// Under three cells along an axis each_pair takes its fallback path
+void test_grid_pairs_few_cells()
+{
+  const float W = 1, H = .5f;
+
+  std::vector<Item> items = scatter( 60, W, H, .2f, 11 );
+
+  CHECK( grid_pairs( items, W, H ) == brute_pairs( items, W, H ) );
+}
+
+// Scratch files are written next to the binary and removed after
+const char *SCRATCH = "tests-scratch.bin";
+
+std::vector<unsigned char> read_file( const char *path )
+{
+  std::vector<unsigned char> bytes;
+  FILE                      *file = fopen( path, "rb" );
+
+  if( file == NULL ) return( bytes );
+
+  unsigned char buffer[ 4096 ];
+  size_t        n;
+
+  while( ( n = fread( buffer, 1, sizeof( buffer ), file ) ) > 0 )
+    bytes.insert( bytes.end(), buffer, buffer + n );
+
+  fclose( file );
+  return( bytes );
+}
+
+bool write_file( const char *path, const std::vector<unsigned char> &bytes )
+{
+  FILE *file = fopen( path, "wb" );
+  if( file == NULL ) return( false );
+
+  bool ok = fwrite( bytes.data(), 1, bytes.size(), file ) == bytes.size();
+
+  return( fclose( file ) == 0 && ok );
+}
+
+// A short session: a few clicks and a key over ten steps
+void record_session( InputLog &log )
+{
+  log.start( 1234 );
+
+  for( int t = 0; t < 10; t++ )
+  {
+    if( t % 3 == 0 ) log.record( INPUT_CLICK, 0, 10 * t, 5 * t );
+    if( t == 7 )     log.record( INPUT_KEY, 'p', 0, 0 );
+
+    log.step();
+  }
+}
+
+void test_input_log_round_trip()
+{
+  InputLog log, loaded;
+  record_session( log );
+
+  CHECK( log.save( SCRATCH ) );
+  CHECK( loaded.load( SCRATCH ) );
+
+  CHECK( loaded.seed == 1234 && loaded.length == 10 && loaded.events.size() == log.events.size() );
+
+  for( size_t i = 0; i < log.events.size() && i < loaded.events.size(); i++ )
+    CHECK( memcmp( &log.events[i], &loaded.events[i], sizeof( InputEvent ) ) == 0 );
+
+  remove( SCRATCH );
+}
+
+// Cut short or padded, a session is refused and the log left empty
+void test_input_log_truncated()
+{
+  InputLog log;
+  record_session( log );
+  CHECK( log.save( SCRATCH ) );
+
+  std::vector<unsigned char> bytes = read_file( SCRATCH );
+  CHECK( bytes.size() > 24 );
+
+  std::vector<unsigned char> cut( bytes.begin(), bytes.end() - 5 );
+  CHECK( write_file( SCRATCH, cut ) );
+  CHECK( !log.load( SCRATCH ) && log.events.empty() );
+
+  std::vector<unsigned char> header_only( bytes.begin(), bytes.begin() + 24 );
+  CHECK( write_file( SCRATCH, header_only ) );
+  CHECK( !log.load( SCRATCH ) && log.events.empty() );
+
+  std::vector<unsigned char> padded( bytes );
+  padded.push_back( 0 );
+  CHECK( write_file( SCRATCH, padded ) );
+  CHECK( !log.load( SCRATCH ) && log.events.empty() );
+
+  remove( SCRATCH );
+}
+
+// A header claiming four billion events is refused without trying to
+// make room for them
+void test_input_log_huge_count()
+{
+  InputLog log;
+  record_session( log );
+  CHECK( log.save( SCRATCH ) );
+
+  std::vector<unsigned char> bytes = read_file( SCRATCH );
+  memset( &bytes[20], 0xff, 4 );
+  CHECK( write_file( SCRATCH, bytes ) );
+
+  bool loaded = true;
+
+  try
+  {
+    loaded = log.load( SCRATCH );
+  }
+  catch( std::bad_alloc & )
+  {
+    CHECK( !"load() tried to allocate for the claimed event count" );
+  }
+
+  CHECK( !loaded && log.events.empty() );
+
+  remove( SCRATCH );
+}
+
+// Side counts the outline arrays cannot hold are clamped when a
+// shape is picked, and the asteroid keeps the count it really got
+void test_shape_sides_clamped()
+{
+  ShapeLibrary &library = ShapeLibrary::shared();
+
+  Asteroid many( Range<>( 0.05f, 0.1f ), 1000 );
+  CHECK( many.sides == ShapeLibrary::MAX_SIDES && library.sides( many.shape ) == many.sides );
+
+  Asteroid few( Range<>( 0.05f, 0.1f ), 1 );
+  CHECK( few.sides == ShapeLibrary::MIN_SIDES && library.sides( few.shape ) == few.sides );
+}
+
+// Writes the world's snapshot to SCRATCH and returns its bytes along
+// with where the shapes section starts
+std::vector<unsigned char> save_snapshot( World &world, uint64_t &shapes_at, uint32_t &vertex_count )
+{
+  CHECK( Snapshot::save( world, SCRATCH ) );
+
+  std::vector<unsigned char> bytes = read_file( SCRATCH );
+  Snapshot::Header           h;
+
+  CHECK( bytes.size() >= sizeof( h ) );
+  if( bytes.size() < sizeof( h ) ) return( bytes );
+
+  memcpy( &h, bytes.data(), sizeof( h ) );
+
+  uint64_t offsets[ Snapshot::SECTION_COUNT ], sizes[ Snapshot::SECTION_COUNT ];
+  Snapshot::layout( h, offsets, sizes );
+
+  shapes_at    = offsets[ Snapshot::SHAPES ];
+  vertex_count = h.vertex_count;
+
+  return( bytes );
+}
+
+// A shape whose side count the outline arrays cannot hold is refused,
+// even when its vertices are all inside the file. The world is emptied
+// first so no asteroid's own checks are what catch it.
+void test_snapshot_bad_sides()
+{
+  World world;
+  world.seed( 5 );
+  world.reset( 20 );
+  world.clear();
+
+  uint64_t shapes_at    = 0;
+  uint32_t vertex_count = 0;
+
+  std::vector<unsigned char> bytes = save_snapshot( world, shapes_at, vertex_count );
+  CHECK( Snapshot::load( world, SCRATCH ) );
+  CHECK( vertex_count > uint32_t( ShapeLibrary::MAX_SIDES ) );
+
+  const int bad[] = { 0, ShapeLibrary::MIN_SIDES - 1, ShapeLibrary::MAX_SIDES + 1 };
+
+  for( size_t i = 0; i < sizeof( bad ) / sizeof( bad[0] ); i++ )
+  {
+    std::vector<unsigned char> damaged( bytes );
+    ShapeLibrary::Shape        shape;
+
+    memcpy( &shape, &damaged[ shapes_at ], sizeof( shape ) );
+    CHECK( shape.offset == 0 );
+
+    shape.sides = bad[i];
+    memcpy( &damaged[ shapes_at ], &shape, sizeof( shape ) );
+
+    CHECK( write_file( SCRATCH, damaged ) );
+    CHECK( !Snapshot::load( world, SCRATCH ) );
+  }
+
+  remove( SCRATCH );
+}
+
+struct Test
+{
+  const char *name;
+  void      (*run)();
+};
+
+const Test TESTS[] =
+{
+  { "grid_query_overlapping",  test_grid_query_overlapping },
+  { "grid_query_wraps",        test_grid_query_wraps },
+  { "grid_query_brute_force",  test_grid_query_brute_force },
+  { "grid_pairs_brute_force",  test_grid_pairs_brute_force },
+  { "grid_pairs_few_cells",    test_grid_pairs_few_cells },
+  { "input_log_round_trip",    test_input_log_round_trip },
+  { "input_log_truncated",     test_input_log_truncated },
+  { "input_log_huge_count",    test_input_log_huge_count },
+  { "shape_sides_clamped",     test_shape_sides_clamped },
+  { "snapshot_bad_sides",      test_snapshot_bad_sides },
+};
+
+int main( int argc, char **argv )
+{
+  const char *filter = NULL;
+
+  if( argc == 3 && strcmp( argv[1], "-f" ) == 0 )
+    filter = argv[2];
+  else if( argc != 1 )
+  {
+    fprintf( stderr, "usage: %s [-f filter]\n", argv[0] );
+    return( 1 );
+  }
+
+  int failed = 0, run = 0;
+
+  for( size_t t = 0; t < sizeof( TESTS ) / sizeof( TESTS[0] ); t++ )
+  {
+    if( filter != NULL && strstr( TESTS[t].name, filter ) == NULL ) continue;
+
+    g_ok = true;
+    TESTS[t].run();
+
+    printf( "%-28s %s\n", TESTS[t].name, g_ok ? "ok" : "FAILED" );
+
+    run++;
+    if( !g_ok ) failed++;
+  }
+
+  printf( "%d of %d tests passed\n", run - failed, run );
+
+  return( failed > 0 ? 1 : 0 );
+}
@@ -0,0 +1,287 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Graphics
+{
+  /* A fixed set of worker threads that run parallel_for() loops.     */
+  /*                                                                  */
+  /* A loop over [0, n) is cut into chunks, and each thread starts     */
+  /* with an equal, contiguous share of them. A thread takes chunks   */
+  /* off the front of its own share. Once that runs out it steals the */
+  /* back half of another thread's share, so a thread that got the    */
+  /* expensive chunks is helped out instead of waited on.             */
+  /*                                                                  */
+  /* The calling thread does work too, so a pool of size 1 starts no  */
+  /* threads and runs every loop inline. Loops must not be started    */
+  /* from inside a loop body.                                         */
+  class ThreadPool
+  {
+  public:
+    unsigned long loops;  // parallel_for() calls that went to the workers
+    unsigned long chunks; // Chunks run
+    unsigned long steals; // Times a thread took work from another one
+
+    // "threads" counts the calling thread; 0 means one per core
+    explicit ThreadPool( int threads = 0 )
+    {
+      this->loops = this->chunks = this->steals = 0;
+      this->thread_count = 0;
+      this->generation   = 0;
+      this->stopping     = false;
+      this->shares       = NULL;
+
+      this->resize( threads );
+    }
+
+    ~ThreadPool()
+    {
+      this->stop();
+      delete [] this->shares;
+    }
+
+    int size() const
+    {
+      return( this->thread_count );
+    }
+
+    static int core_count()
+    {
+      int cores = std::thread::hardware_concurrency();
+      return( cores > 0 ? cores : 1 );
+    }
+
+    void resize( int threads )
+    {
+      if( threads <= 0 ) threads = core_count();
+      if( threads == this->thread_count ) return;
+
+      this->stop();
+
+      delete [] this->shares;
+      this->shares       = new Share[ threads ];
+      this->thread_count = threads;
+
+      // New workers wait for the next job, not the last one
+      unsigned long generation;
+      {
+        std::lock_guard< std::mutex > lock( this->mutex );
+        this->stopping = false;
+        generation     = this->generation;
+      }
+
+      for( int i = 1; i < threads; i++ )
+        this->workers.push_back( std::thread( &ThreadPool::work, this, i, generation ) );
+    }
+
+    // Calls body( begin, end ) over [0, n) in chunks of "chunk" items,
+    // spread across the pool. Returns once every chunk has run.
+    template< typename F >
+    void parallel_for( int n, int chunk, F body )
+    {
+      if( n <= 0 ) return;
+      if( chunk < 1 ) chunk = 1;
+
+      int chunk_count = ( n + chunk - 1 ) / chunk;
+
+      if( this->thread_count == 1 || chunk_count == 1 )
+      {
+        body( 0, n );
+        return;
+      }
+
+      Job job;
+      job.run         = &ThreadPool::call< F >;
+      job.body        = &body;
+      job.n           = n;
+      job.chunk       = chunk;
+      this->job       = job;
+      this->remaining = chunk_count;
+
+      for( int i = 0; i < this->thread_count; i++ )
+        this->shares[i].range.store( pack( uint32_t( (int64_t)chunk_count * i / this->thread_count ),
+                                           uint32_t( (int64_t)chunk_count * ( i + 1 ) / this->thread_count ) ) );
+
+      {
+        std::lock_guard< std::mutex > lock( this->mutex );
+        this->busy = this->thread_count - 1;
+        this->generation++;
+      }
+      this->wake.notify_all();
+
+      this->run_chunks( 0 );
+
+      // Every worker has to check in, even if there was nothing left
+      // for it, before the job (which lives on this stack) goes away
+      while( this->remaining.load() > 0 || this->busy.load() > 0 )
+        std::this_thread::yield();
+
+      this->loops++;
+      this->chunks += chunk_count;
+      for( int i = 0; i < this->thread_count; i++ )
+      {
+        this->steals += this->shares[i].steals;
+        this->shares[i].steals = 0;
+      }
+    }
+
+  private:
+    struct Job
+    {
+      void (*run)( void *body, int begin, int end );
+      void *body;
+      int   n;
+      int   chunk;
+    };
+
+    // The chunks a thread has left, as [first, last) packed into one
+    // word so the owner and thieves can both update it with one CAS
+    struct Share
+    {
+      std::atomic< uint64_t > range;
+      unsigned long           steals;
+      char                    pad[ 64 - sizeof( uint64_t ) - sizeof( unsigned long ) ];
+
+      Share() : range( 0 ), steals( 0 ) {}
+    };
+
+    int                        thread_count;
+    std::vector< std::thread > workers;
+    Share                     *shares;
+
+    Job               job;
+    std::atomic<int>  remaining; // Chunks of the current job not yet run
+    std::atomic<int>  busy;      // Workers still inside the current job
+
+    std::mutex              mutex;
+    std::condition_variable wake;
+    unsigned long           generation; // Bumped for every job
+    bool                    stopping;
+
+    ThreadPool( const ThreadPool & );
+    ThreadPool &operator=( const ThreadPool & );
+
+    template< typename F >
+    static void call( void *body, int begin, int end )
+    {
+      ( *(F*)body )( begin, end );
+    }
+
+    static uint64_t pack( uint32_t first, uint32_t last )
+    {
+      return( ( uint64_t( last ) << 32 ) | first );
+    }
+
+    static uint32_t first_of( uint64_t range ) { return( uint32_t( range ) ); }
+    static uint32_t last_of( uint64_t range )  { return( uint32_t( range >> 32 ) ); }
+
+    void stop()
+    {
+      {
+        std::lock_guard< std::mutex > lock( this->mutex );
+        this->stopping = true;
+      }
+      this->wake.notify_all();
+
+      for( size_t i = 0; i < this->workers.size(); i++ )
+        this->workers[i].join();
+
+      this->workers.clear();
+    }
+
+    // "seen" is the generation of the last job this worker has done
+    void work( int self, unsigned long seen )
+    {
+      for( ;; )
+      {
+        {
+          std::unique_lock< std::mutex > lock( this->mutex );
+          while( !this->stopping && this->generation == seen )
+            this->wake.wait( lock );
+
+          if( this->stopping ) return;
+          seen = this->generation;
+        }
+
+        this->run_chunks( self );
+        this->busy--;
+      }
+    }
+
+    // Runs chunks from our own share, then from whoever still has some
+    void run_chunks( int self )
+    {
+      for( ;; )
+      {
+        int chunk;
+        while( ( chunk = this->take( self ) ) >= 0 )
+        {
+          int begin = chunk * this->job.chunk;
+          int end   = begin + this->job.chunk;
+          if( end > this->job.n ) end = this->job.n;
+
+          this->job.run( this->job.body, begin, end );
+          this->remaining--;
+        }
+
+        if( !this->steal( self ) ) return;
+      }
+    }
+
+    // Takes the next chunk off the front of our share, or returns -1
+    int take( int self )
+    {
+      std::atomic< uint64_t > &range = this->shares[ self ].range;
+      uint64_t current = range.load();
+
+      for( ;; )
+      {
+        uint32_t first = first_of( current );
+        uint32_t last  = last_of( current );
+
+        if( first >= last ) return( -1 );
+
+        if( range.compare_exchange_weak( current, pack( first + 1, last ) ) )
+          return( first );
+      }
+    }
+
+    // Moves the back half of some other thread's share into ours (which
+    // is empty). Returns false once there is nothing left anywhere.
+    bool steal( int self )
+    {
+      for( int i = 1; i < this->thread_count; i++ )
+      {
+        std::atomic< uint64_t > &victim = this->shares[ ( self + i ) % this->thread_count ].range;
+        uint64_t current = victim.load();
+
+        for( ;; )
+        {
+          uint32_t first = first_of( current );
+          uint32_t last  = last_of( current );
+
+          if( first >= last ) break;
+
+          uint32_t middle = first + ( last - first ) / 2;
+
+          if( victim.compare_exchange_weak( current, pack( first, middle ) ) )
+          {
+            this->shares[ self ].range.store( pack( middle, last ) );
+            this->shares[ self ].steals++;
+            return( true );
+          }
+        }
+      }
+
+      return( false );
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef TIMESTEP_H
+#define TIMESTEP_H
+
+namespace Graphics
+{
+  /* Turns wall clock time into a whole number of fixed-size          */
+  /* simulation steps, so the game runs at the same speed however     */
+  /* fast or slow frames are drawn.                                   */
+  /*                                                                  */
+  /* Each frame, the time since the last frame goes into an           */
+  /* accumulator and one step runs for every "dt" it holds. What is   */
+  /* left over (less than one step) is alpha(), the fraction of the   */
+  /* way from the previous state to the current one that the frame    */
+  /* should be drawn at.                                              */
+  /*                                                                  */
+  /* After a long stall (a dragged window, a debugger) the backlog    */
+  /* could take longer to simulate than it covers. At most max_steps  */
+  /* run per frame; the rest are dropped and the game slows down      */
+  /* instead of locking up.                                           */
+  class FixedTimestep
+  {
+  public:
+    double dt;        // Seconds of game time per step
+    int    max_steps; // Most steps run in one frame
+
+    unsigned long frames;    // Calls to advance()
+    unsigned long steps;     // Steps run
+    unsigned long caught_up; // Steps run beyond the first in a frame
+    unsigned long dropped;   // Steps thrown away to stay within max_steps
+
+    FixedTimestep( double dt = 0.05, int max_steps = 5 )
+    {
+      this->dt        = dt;
+      this->max_steps = max_steps;
+
+      this->reset();
+    }
+
+    // Forgets the backlog; the next advance() starts the clock
+    void reset()
+    {
+      this->last        = -1;
+      this->accumulator = 0;
+
+      this->frames = this->steps = this->caught_up = this->dropped = 0;
+    }
+
+    // Calls step() once for every dt that passed up to "now" (in
+    // seconds) and returns how many times it did
+    template< typename F >
+    int advance( double now, F step )
+    {
+      this->frames++;
+
+      if( this->last < 0 )
+        this->last = now;
+
+      this->accumulator += now - this->last;
+      this->last = now;
+
+      int due = int( this->accumulator / this->dt );
+
+      if( due > this->max_steps )
+      {
+        this->dropped     += due - this->max_steps;
+        this->accumulator -= ( due - this->max_steps ) * this->dt;
+        due = this->max_steps;
+      }
+
+      for( int i = 0; i < due; i++ )
+        step();
+
+      this->accumulator -= due * this->dt;
+
+      this->steps += due;
+      if( due > 1 )
+        this->caught_up += due - 1;
+
+      return( due );
+    }
+
+    // How far between the last two states to draw, in [0, 1)
+    float alpha() const
+    {
+      float alpha = float( this->accumulator / this->dt );
+
+      return( alpha < 0 ? 0 : alpha );
+    }
+
+  private:
+    double last;        // Time of the previous advance(), or -1
+    double accumulator; // Time not yet simulated
+  };
+}
+
+#endif
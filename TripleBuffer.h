@@ -0,0 +1,81 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+namespace Graphics
+{
+  /* Hands the newest of a stream of values from one thread to       */
+  /* another without either ever waiting. There are three slots: the  */
+  /* writer fills the back one, the reader reads the front one and    */
+  /* the third sits in the middle holding the newest published value. */
+  /* Publishing swaps back and middle, reading something new swaps    */
+  /* middle and front; each swap is one atomic exchange of an index.  */
+  /*                                                                  */
+  /* The reader always gets the latest complete value and keeps it    */
+  /* until it asks again. Values it never got to are overwritten,     */
+  /* which is the point: a slow reader skips states rather than       */
+  /* holding up the writer. Slots are reused, so a value that owns    */
+  /* memory (vectors) keeps its capacity from one round to the next.  */
+  template< typename T >
+  class TripleBuffer
+  {
+  public:
+    unsigned long published; // By the writer
+    unsigned long skipped;   // Published but replaced before the reader got to them
+
+    TripleBuffer()
+    {
+      this->back_index  = 0;
+      this->front_index = 1;
+      this->middle.store( 2 );
+
+      this->published = 0;
+      this->skipped   = 0;
+    }
+
+    // Writer: the slot to fill before the next publish()
+    T &back()
+    {
+      return( this->slots[ this->back_index ] );
+    }
+
+    // Writer: makes the back slot the newest value and takes over
+    // whichever slot the reader is not holding
+    void publish()
+    {
+      int previous = this->middle.exchange( this->back_index | FRESH, std::memory_order_acq_rel );
+
+      if( previous & FRESH )
+        this->skipped++;
+
+      this->back_index = previous & INDEX;
+      this->published++;
+    }
+
+    // Reader: the newest published value, or a default constructed
+    // one before anything was published
+    const T &latest()
+    {
+      if( this->middle.load( std::memory_order_relaxed ) & FRESH )
+        this->front_index = this->middle.exchange( this->front_index, std::memory_order_acq_rel ) & INDEX;
+
+      return( this->slots[ this->front_index ] );
+    }
+
+  private:
+    static const int INDEX = 3; // Slot number bits of "middle"
+    static const int FRESH = 4; // Set while the middle slot has not been read
+
+    T slots[3];
+
+    alignas( 64 ) int              back_index;  // Writer's own
+    alignas( 64 ) std::atomic<int> middle;
+    alignas( 64 ) int              front_index; // Reader's own
+
+    TripleBuffer( const TripleBuffer & );
+    TripleBuffer &operator=( const TripleBuffer & );
+  };
+}
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef VECTOR_MATH_H
+#define VECTOR_MATH_H
+
+#include "FastMath.h"
+
+namespace Graphics
+{
+  /* Value types for the game's 2D math. float2 is a point or a       */
+  /* direction; float4 is four floats packed into one 16 byte aligned */
+  /* block (two points, or a box as min x, min y, max x, max y).      */
+  /*                                                                  */
+  /* Both are literal types: their operators are constexpr and take   */
+  /* their arguments by value, which for 8 and 16 bytes is as cheap   */
+  /* as a reference and keeps them in registers. An array of float2   */
+  /* is laid out exactly as x,y,x,y... floats, so vertex data goes to */
+  /* GL or a draw list as it is, and the batch operations below work  */
+  /* over such arrays. Point<> and Vector2<> are thin adapters.       */
+  struct float2
+  {
+    float x, y;
+
+    constexpr float2() : x( 0 ), y( 0 ) {}
+    constexpr float2( float x, float y ) : x( x ), y( y ) {}
+  };
+
+  static_assert( sizeof( float2 ) == 2 * sizeof( float ), "an array of float2 is an array of x,y floats" );
+
+  struct alignas( 16 ) float4
+  {
+    float x, y, z, w;
+
+    constexpr float4() : x( 0 ), y( 0 ), z( 0 ), w( 0 ) {}
+    constexpr float4( float x, float y, float z, float w ) : x( x ), y( y ), z( z ), w( w ) {}
+    constexpr float4( float2 a, float2 b ) : x( a.x ), y( a.y ), z( b.x ), w( b.y ) {}
+
+    constexpr float2 lo() const { return( float2( x, y ) ); }
+    constexpr float2 hi() const { return( float2( z, w ) ); }
+  };
+
+  constexpr float2 operator+( float2 a, float2 b ) { return( float2( a.x + b.x, a.y + b.y ) ); }
+  constexpr float2 operator-( float2 a, float2 b ) { return( float2( a.x - b.x, a.y - b.y ) ); }
+  constexpr float2 operator-( float2 a )           { return( float2( -a.x, -a.y ) ); }
+  constexpr float2 operator*( float2 a, float s )  { return( float2( a.x * s, a.y * s ) ); }
+  constexpr float2 operator*( float s, float2 a )  { return( float2( a.x * s, a.y * s ) ); }
+
+  constexpr bool operator==( float2 a, float2 b ) { return( a.x == b.x && a.y == b.y ); }
+  constexpr bool operator!=( float2 a, float2 b ) { return( !( a == b ) ); }
+
+  inline float2 &operator+=( float2 &a, float2 b ) { a.x += b.x; a.y += b.y; return( a ); }
+  inline float2 &operator-=( float2 &a, float2 b ) { a.x -= b.x; a.y -= b.y; return( a ); }
+  inline float2 &operator*=( float2 &a, float s )  { a.x *= s;   a.y *= s;   return( a ); }
+
+  constexpr float dot( float2 a, float2 b )   { return( a.x * b.x + a.y * b.y ); }
+  constexpr float cross( float2 a, float2 b ) { return( a.x * b.y - a.y * b.x ); }
+
+  constexpr float length_squared( float2 a )             { return( dot( a, a ) ); }
+  constexpr float distance_squared( float2 a, float2 b ) { return( length_squared( b - a ) ); }
+
+  inline float length( float2 a )             { return( FastMath::sqrt( length_squared( a ) ) ); }
+  inline float distance( float2 a, float2 b ) { return( FastMath::sqrt( distance_squared( a, b ) ) ); }
+
+  // a + ( b - a ) * t
+  constexpr float2 lerp( float2 a, float2 b, float t ) { return( float2( a.x + ( b.x - a.x ) * t, a.y + ( b.y - a.y ) * t ) ); }
+
+  // Turned by the angle whose sine and cosine are s and c
+  constexpr float2 rotate( float2 a, float s, float c ) { return( float2( c * a.x - s * a.y, s * a.x + c * a.y ) ); }
+
+  constexpr float2 min( float2 a, float2 b ) { return( float2( a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y ) ); }
+  constexpr float2 max( float2 a, float2 b ) { return( float2( a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y ) ); }
+
+  constexpr float4 operator+( float4 a, float4 b ) { return( float4( a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w ) ); }
+  constexpr float4 operator-( float4 a, float4 b ) { return( float4( a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w ) ); }
+  constexpr float4 operator*( float4 a, float s )  { return( float4( a.x * s, a.y * s, a.z * s, a.w * s ) ); }
+
+  constexpr float4 min( float4 a, float4 b )
+  {
+    return( float4( a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z, a.w < b.w ? a.w : b.w ) );
+  }
+
+  // Whether two boxes (min x, min y, max x, max y) overlap
+  constexpr bool overlaps( float4 a, float4 b )
+  {
+    return( a.x <= b.z && b.x <= a.z && a.y <= b.w && b.y <= a.w );
+  }
+
+  // The floats of an array of float2s (or Point<>s), for GL and the
+  // particle kernels
+  inline float       *floats( float2 *points )       { return( &points->x ); }
+  inline const float *floats( const float2 *points ) { return( &points->x ); }
+
+  // Batch operations over "n" consecutive points. "in" and "out" may
+  // be the same array.
+
+  // out = rotate( in, s, c ) + offset
+  inline void transform( const float2 *in, int n, float s, float c, float2 offset, float2 *out )
+  {
+    for( int i = 0; i < n; i++ )
+      out[i] = rotate( in[i], s, c ) + offset;
+  }
+
+  inline void translate( float2 *points, int n, float2 by )
+  {
+    for( int i = 0; i < n; i++ )
+      points[i] += by;
+  }
+
+  // Smallest box around n > 0 points, as ( min x, min y, max x, max y ).
+  // The maximum is kept negated so all four lanes take one min.
+  inline float4 bounds( const float2 *points, int n )
+  {
+    float4 box( points[0], -points[0] );
+
+    for( int i = 1; i < n; i++ )
+      box = min( box, float4( points[i], -points[i] ) );
+
+    return( float4( box.lo(), -box.hi() ) );
+  }
+}
+
+#endif
@@ -0,0 +1,506 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include "Graphics.h"
+#include "Asteroid.h"
+#include "EntityStore.h"
+#include "SpatialGrid.h"
+#include "Collision.h"
+#include "Clock.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+#include "ParticleBudget.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace Graphics
+{
+  /* The World owns every asteroid and particle system and knows how  */
+  /* to step them, explode them and pause them. It never calls into   */
+  /* OpenGL, so it can be driven by GLUT or by the headless driver.   */
+  class World
+  {
+  public:
+    EntityStore<Asteroid>       asteroids; // Every Asteroid, packed by value
+    EntityStore<ParticleSystem> particles; // Every live ParticleSystem, packed by value
+
+    float ratio[2];         // Size of the playing field { w, h }
+
+    ParticleBudget budget;  // Caps particles and sizes new systems
+    bool  is_paused;
+
+    unsigned long ticks;
+    unsigned long explosions;
+
+    SpatialGrid grid;       // Index of asteroids, rebuilt every tick
+    bool        use_grid;   // Whether clicks go through the grid
+    bool        grid_dirty; // The asteroid store changed since the last build
+
+    CollisionMode  collision_mode;
+    CollisionStats collision_stats; // Of the last tick
+
+    ThreadPool pool;           // Runs the per-tick asteroid and particle steps
+    int        asteroid_chunk; // Asteroids per parallel chunk
+    int        particle_chunk; // Particle systems per parallel chunk
+    double     step_time;      // Seconds spent in those steps last tick
+
+    Profiler  *profiler; // Times the phases of update(), if set
+
+    Random<Real> random;
+
+    World()
+    {
+      this->ratio[0] = 4.0f;
+      this->ratio[1] = 3.0f;
+
+      this->is_paused = false;
+
+      this->ticks      = 0;
+      this->explosions = 0;
+
+      this->use_grid   = true;
+      this->grid_dirty = true;
+
+      this->collision_mode = COLLIDE_BOUNCE;
+
+      this->asteroid_chunk = 1024;
+      this->particle_chunk = 1;
+      this->step_time      = 0;
+
+      this->profiler = NULL;
+    }
+
+    // Seeds every random number drawn from here on, the world's own
+    // spawn points included, so a run can be played again exactly
+    void seed( uint64_t seed )
+    {
+      seed_random( seed );
+      this->random.seed( mix_seed( seed ) );
+    }
+
+    // Deletes every asteroid and particle system in the world
+    void clear()
+    {
+      this->asteroids.clear();
+      this->particles.clear();
+
+      this->grid_dirty = true;
+    }
+
+    // Throws away the current world and generates "count" new
+    // asteroids at random points on the screen
+    void reset( int count = 12, Range<> size = Range<>( .1f, .2f ) )
+    {
+      this->clear();
+
+      this->is_paused  = false;
+      this->ticks      = 0;
+      this->explosions = 0;
+
+      this->spawn( count, size );
+    }
+
+    void spawn( int count, Range<> size = Range<>( .1f, .2f ) )
+    {
+      Point<Real> random_point;
+      for( int i = 0; i < count; i++ )
+      {
+        random_point.x = this->random.next( Real( -this->ratio[0]/2.0f ), Real( this->ratio[0]/2.0f ) );
+        random_point.y = this->random.next( Real( -this->ratio[1]/2.0f ), Real( this->ratio[1]/2.0f ) );
+
+        Asteroid asteroid( size );
+        asteroid.move_to( random_point );
+
+        this->asteroids.insert( std::move( asteroid ) );
+      }
+
+      this->grid_dirty = true;
+    }
+
+    // Advances every asteroid and particle system by one tick, and
+    // deletes the particle systems that have faded out
+    void update()
+    {
+      {
+        Profiler::Scope scope( this->profiler, Profiler::PARTICLES );
+
+        // Walk backwards so removing (which moves the last system into
+        // the hole) never skips one. This has to happen before the
+        // parallel step, since giving buffers back to the pool is not
+        // thread safe.
+        for( int i = this->particles.size() - 1; i >= 0; i-- )
+          if( this->particles[i].is_expired() )
+            this->particles.remove_at( i );
+      }
+
+      double start = now_in_seconds();
+
+      {
+        Profiler::Scope scope( this->profiler, Profiler::ASTEROIDS );
+
+        this->pool.parallel_for( this->asteroids.size(), this->asteroid_chunk, [&]( int begin, int end )
+        {
+          for( int i = begin; i < end; i++ )
+          {
+            Asteroid &asteroid = this->asteroids[i];
+
+            asteroid.update();
+            asteroid.check_boundaries( this->ratio[1], this->ratio[0] );
+          }
+        } );
+      }
+
+      this->step_time = now_in_seconds() - start;
+
+      if( !this->is_paused )
+        this->grid_dirty = true;
+
+      {
+        Profiler::Scope scope( this->profiler, Profiler::COLLISIONS );
+        this->collide();
+      }
+
+      start = now_in_seconds();
+
+      {
+        Profiler::Scope scope( this->profiler, Profiler::PARTICLES );
+
+        this->pool.parallel_for( this->particles.size(), this->particle_chunk, [&]( int begin, int end )
+        {
+          for( int i = begin; i < end; i++ )
+            this->particles[i].update();
+        } );
+      }
+
+      double particle_time = now_in_seconds() - start;
+
+      this->step_time += particle_time;
+      this->budget.observe( this->particle_count(), particle_time );
+
+      if( !this->is_paused )
+        this->ticks++;
+
+      Profiler::Scope scope( this->profiler, Profiler::COLLISIONS );
+      this->refresh_grid();
+    }
+
+    // Finds touching asteroids and bounces or fragments them.
+    //   broad phase:  grid neighbours whose radius_range.max circles overlap
+    //   narrow phase: circles around the actual shapes, then an exact
+    //                 test of the two rotated outlines
+    void collide()
+    {
+      CollisionStats &stats = this->collision_stats;
+      stats.reset();
+
+      if( this->collision_mode == COLLIDE_NONE || this->is_paused ) return;
+
+      double start = now_in_seconds();
+      this->refresh_grid();
+      double grid_done = now_in_seconds();
+
+      float w = this->ratio[0];
+      float h = this->ratio[1];
+
+      this->pairs.clear();
+      this->grid.each_pair( [&]( int i, int j )
+      {
+        stats.grid_candidates++;
+
+        Asteroid &a = this->asteroids[i];
+        Asteroid &b = this->asteroids[j];
+
+        Point<> d  = to_float( b.location ) - to_float( a.location );
+        float   dx = SpatialGrid::wrapped( d.x, w );
+        float   dy = SpatialGrid::wrapped( d.y, h );
+        float   r  = a.radius_range.max + b.radius_range.max;
+
+        if( dx*dx + dy*dy <= r*r )
+        {
+          this->pairs.push_back( i );
+          this->pairs.push_back( j );
+        }
+      } );
+      stats.broad_pairs = this->pairs.size() / 2;
+      double broad_done = now_in_seconds();
+
+      // Keep only the pairs whose outlines touch, and remember the
+      // offset that brings b next to a across the wrap
+      this->contacts.clear();
+      for( size_t p = 0; p < this->pairs.size(); p += 2 )
+      {
+        Asteroid &a = this->asteroids[ this->pairs[p] ];
+        Asteroid &b = this->asteroids[ this->pairs[p + 1] ];
+
+        Point<> la = to_float( a.location );
+        Point<> lb = to_float( b.location );
+
+        float dx = SpatialGrid::wrapped( lb.x - la.x, w );
+        float dy = SpatialGrid::wrapped( lb.y - la.y, h );
+        Point<> offset( la.x + dx - lb.x, la.y + dy - lb.y );
+
+        float r = a.outer_radius + b.outer_radius;
+        if( dx*dx + dy*dy > r*r ) continue;
+
+        if( Collision::approaching( a, b, Point<>( dx, dy ) ) && Collision::outlines_overlap( a, b, offset ) )
+        {
+          this->contacts.push_back( this->pairs[p] );
+          this->contacts.push_back( this->pairs[p + 1] );
+        }
+      }
+      stats.contacts = this->contacts.size() / 2;
+      double narrow_done = now_in_seconds();
+
+      this->respond( w, h );
+
+      stats.grid_time     = grid_done - start;
+      stats.broad_time    = broad_done - grid_done;
+      stats.narrow_time   = narrow_done - broad_done;
+      stats.response_time = now_in_seconds() - narrow_done;
+    }
+
+    void refresh_grid()
+    {
+      if( !this->grid_dirty ) return;
+
+      this->grid.build( this->asteroids, this->asteroids.size(), this->ratio[0], this->ratio[1] );
+      this->grid_dirty = false;
+    }
+
+    // Explodes the first asteroid under the given coordinates.
+    // Returns whether an asteroid was hit.
+    bool click( Point<> coordinates )
+    {
+      return( this->click_all( &coordinates, 1 ) > 0 );
+    }
+
+    // Explodes the first asteroid under each of "count" coordinates.
+    // Every click is looked up in the world as it was before any of
+    // them, so they share one grid build instead of one each, and an
+    // asteroid under several clicks explodes once. Returns how many
+    // asteroids exploded.
+    int click_all( const Point<> *coordinates, int count )
+    {
+      if( this->is_paused ) return( 0 );
+
+      this->hits.clear();
+
+      for( int c = 0; c < count; c++ )
+      {
+        int i = this->pick( coordinates[c] );
+
+        if( i >= 0 )
+          this->hits.push_back( i );
+      }
+
+      std::sort( this->hits.begin(), this->hits.end() );
+      this->hits.erase( std::unique( this->hits.begin(), this->hits.end() ), this->hits.end() );
+
+      // Highest index first, as in respond()
+      for( int h = int( this->hits.size() ) - 1; h >= 0; h-- )
+        this->explode( this->hits[h] );
+
+      return( int( this->hits.size() ) );
+    }
+
+    // Dense index of an asteroid under the given coordinates, or -1.
+    // Where asteroids overlap, which one is picked is unspecified (the
+    // linear walk finds the lowest index, the grid the first it visits).
+    int pick( Point<> coordinates )
+    {
+      if( !this->use_grid )
+      {
+        for( int i = 0, n = this->asteroids.size(); i < n; i++ )
+          if( this->asteroids[i].hit_test( coordinates ) )
+            return( i );
+
+        return( -1 );
+      }
+
+      this->refresh_grid();
+
+      int hit = -1;
+      this->grid.each_at_point( coordinates, [&]( int i )
+      {
+        if( this->asteroids[i].hit_test( coordinates ) )
+          hit = i;
+
+        return( hit < 0 );
+      } );
+
+      return( hit );
+    }
+
+    // Removes the asteroid at dense index i, replacing it with its
+    // fragments (if it has any left) and a particle system
+    void explode( int i )
+    {
+      Asteroid asteroid( std::move( this->asteroids[i] ) );
+      this->asteroids.remove_at( i );
+
+      if( asteroid.can_explode() )
+        for( int f = 0; f < asteroid.fragment_count; f++ )
+          this->asteroids.insert( asteroid.get_fragment( f ) );
+
+      this->add_particles( to_float( asteroid.location ) );
+      this->explosions++;
+
+      this->grid_dirty = true;
+    }
+
+    // Sets off a particle system at "where", as big as the budget
+    // allows, retiring the oldest systems if even that does not fit
+    void add_particles( Point<> where )
+    {
+      int live  = this->particle_count();
+      int count = this->budget.count_for( live );
+
+      while( !this->budget.fits( live, count ) )
+      {
+        int oldest = -1;
+
+        for( int i = 0, n = this->particles.size(); i < n; i++ )
+          if( !this->particles[i].is_expired() &&
+              ( oldest < 0 || this->particles[i].display_count > this->particles[ oldest ].display_count ) )
+            oldest = i;
+
+        if( oldest < 0 ) break;
+
+        live -= this->particles[ oldest ].count;
+        this->particles[ oldest ].retire();
+        this->budget.retired++;
+      }
+
+      this->particles.insert( ParticleSystem( where, count ) );
+      this->budget.spawned_system( count );
+    }
+
+  private:
+    std::vector<int>  pairs;    // Collision scratch: index pairs, flattened
+    std::vector<int>  contacts;
+    std::vector<char> doomed;   // Asteroids to fragment this tick
+    std::vector<int>  hits;     // Asteroids under a batch of clicks
+
+    void respond( float w, float h )
+    {
+      bool fragment = ( this->collision_mode == COLLIDE_FRAGMENT );
+
+      if( fragment )
+        this->doomed.assign( this->asteroids.size(), 0 );
+
+      for( size_t p = 0; p < this->contacts.size(); p += 2 )
+      {
+        int i = this->contacts[p];
+        int j = this->contacts[p + 1];
+
+        Asteroid &a = this->asteroids[i];
+        Asteroid &b = this->asteroids[j];
+
+        if( fragment && a.can_explode() && b.can_explode() )
+        {
+          this->doomed[i] = this->doomed[j] = 1;
+          continue;
+        }
+
+        Point<> d = to_float( b.location ) - to_float( a.location );
+        Point<> normal( SpatialGrid::wrapped( d.x, w ), SpatialGrid::wrapped( d.y, h ) );
+
+        Collision::bounce( a, b, normal );
+      }
+
+      // Highest index first: explode() only disturbs the index it
+      // removes and the end of the store, so lower ones stay valid
+      if( fragment )
+        for( int i = int( this->doomed.size() ) - 1; i >= 0; i-- )
+          if( this->doomed[i] )
+            this->explode( i );
+    }
+
+  public:
+    void set_paused( bool paused )
+    {
+      this->is_paused = paused;
+
+      for( int i = 0, n = this->asteroids.size(); i < n; i++ )
+        this->asteroids[i].is_paused = paused;
+
+      for( int i = 0, n = this->particles.size(); i < n; i++ )
+        this->particles[i].is_paused = paused;
+    }
+
+    void toggle_pause()
+    {
+      this->set_paused( !this->is_paused );
+    }
+
+    // Particles in systems that have not expired yet
+    int particle_count()
+    {
+      int total = 0;
+
+      for( int i = 0, n = this->particles.size(); i < n; i++ )
+        if( !this->particles[i].is_expired() )
+          total += this->particles[i].count;
+
+      return( total );
+    }
+
+    // FNV-1a hash of where everything is, how it is moving and what
+    // shape it has. Two runs that hash the same after the same tick
+    // went identically.
+    uint64_t checksum()
+    {
+      uint64_t hash = 14695981039346656037ULL;
+
+      hash = fnv( hash, &this->ticks, sizeof( this->ticks ) );
+
+      ShapeLibrary     &library = ShapeLibrary::shared();
+      std::vector<bool> used( library.shape_count() );
+
+      for( int i = 0, n = this->asteroids.size(); i < n; i++ )
+      {
+        Asteroid &a = this->asteroids[i];
+
+        hash = fnv( hash, &a.location,   sizeof( a.location ) );
+        hash = fnv( hash, &a.velocity.p, sizeof( a.velocity.p ) );
+        hash = fnv( hash, &a.rotation,   sizeof( a.rotation ) );
+        hash = fnv( hash, &a.shape,      sizeof( a.shape ) );
+
+        used[ a.shape ] = true;
+      }
+
+      // The outlines themselves, once per shape in use, so a change to
+      // how shapes are generated shows up even before it moves anything
+      for( int shape = 0, n = library.shape_count(); shape < n; shape++ )
+        if( used[ shape ] )
+          hash = fnv( hash, library.points( shape ), library.sides( shape ) * sizeof( Point<> ) );
+
+      for( int i = 0, n = this->particles.size(); i < n; i++ )
+      {
+        ParticleSystem &p = this->particles[i];
+
+        hash = fnv( hash, &p.count, sizeof( p.count ) );
+        if( p.is_clean ) continue;
+
+        hash = fnv( hash, p.x, p.count * sizeof( float ) );
+        hash = fnv( hash, p.y, p.count * sizeof( float ) );
+      }
+
+      return( hash );
+    }
+
+  private:
+    static uint64_t fnv( uint64_t hash, const void *data, size_t bytes )
+    {
+      const unsigned char *p = (const unsigned char *)data;
+
+      for( size_t i = 0; i < bytes; i++ )
+        hash = ( hash ^ p[i] ) * 1099511628211ULL;
+
+      return( hash );
+    }
+  };
+}
+
+#endif